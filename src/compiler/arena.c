@@ -0,0 +1,98 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK_SIZE 65536
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size; /* usable bytes after the header */
+    size_t used; /* bytes handed out */
+};
+
+#define BLOCK_DATA(block) ((char*) (block) + ALIGN_UP(sizeof(struct arena_block)))
+
+//
+// Allocate a new block holding at least `size` bytes.
+//
+static struct arena_block *new_block(size_t size)
+{
+    struct arena_block *block;
+
+    if (size < ARENA_BLOCK_SIZE)
+        size = ARENA_BLOCK_SIZE;
+
+    if (!(block = malloc(ALIGN_UP(sizeof(struct arena_block)) + size))) {
+        fprintf(stderr, "out of memory in arena_alloc()\n");
+        exit(1);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+//
+// Allocate `size` zero-filled bytes, aligned for any object.
+//
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    struct arena_block *block = arena->cur, *fresh;
+    void *ptr;
+
+    size = ALIGN_UP(size);
+
+    if (!block)
+        arena->head = arena->cur = block = new_block(size);
+
+    // move on to the next block kept from an earlier round, or add one
+    while (block->size - block->used < size) {
+        if (!block->next || block->next->size < size) {
+            fresh = new_block(size);
+            fresh->next = block->next;
+            block->next = fresh;
+        }
+        block = block->next;
+        block->used = 0;
+    }
+    arena->cur = block;
+
+    ptr = BLOCK_DATA(block) + block->used;
+    block->used += size;
+
+    arena->used += size;
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+    return memset(ptr, 0, size);
+}
+
+//
+// Release all objects, keeping the memory for reuse.
+//
+void arena_reset(struct arena *arena)
+{
+    arena->cur = arena->head;
+    if (arena->head)
+        arena->head->used = 0;
+    arena->used = 0;
+}
+
+//
+// Return all memory to the system.
+//
+void arena_free(struct arena *arena)
+{
+    struct arena_block *block, *next;
+
+    for (block = arena->head; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+    arena->head = arena->cur = NULL;
+    arena->used = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef BCAUSE_ARENA_H
+#define BCAUSE_ARENA_H
+
+#include <stddef.h>
+
+struct arena_block;
+
+//
+// Bump allocator.
+// Objects are never freed one by one; the whole arena is rewound at once
+// and its blocks are reused for the next round of allocations.
+//
+struct arena {
+    struct arena_block *head; /* first block */
+    struct arena_block *cur; /* block allocations are made from */
+
+    size_t used; /* bytes handed out since the last reset */
+    size_t peak; /* most bytes ever handed out between two resets */
+};
+
+//
+// Allocate `size` zero-filled bytes, aligned for any object.
+//
+void *arena_alloc(struct arena *arena, size_t size);
+
+//
+// Release all objects, keeping the memory for reuse.
+//
+void arena_reset(struct arena *arena);
+
+//
+// Return all memory to the system.
+//
+void arena_free(struct arena *arena);
+
+#endif /* BCAUSE_ARENA_H */
@@ -0,0 +1,121 @@
+#ifndef BCAUSE_AST_H
+#define BCAUSE_AST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+enum cmp_operator {
+    CMP_LT = 0, /* less-than operator */
+    CMP_LE, /* less-than-equal operator */
+    CMP_GT, /* greater-than operator */
+    CMP_GE, /* greater-than-equal operator */
+    CMP_EQ, /* equality operator */
+    CMP_NE  /* non-equality operator */
+};
+
+enum binary_operator {
+    /* + */     BIN_ADD = 0,
+    /* - */     BIN_SUB,
+    /* * */     BIN_MUL,
+    /* / */     BIN_DIV,
+    /* % */     BIN_MOD,
+    /* << */    BIN_SHL,
+    /* >> */    BIN_SAR,
+    /* & */     BIN_AND,
+    /* | */     BIN_OR,
+};
+
+enum node_kind {
+    /* expressions */
+    NODE_NUMBER,        /* integer or character literal `value` */
+    NODE_STRING,        /* string literal, `value` is its index in the string table */
+    NODE_LOCAL,         /* argument or auto variable, `value` is its stack slot */
+    NODE_EXTRN,         /* external variable or function `name` */
+    NODE_INDEX,         /* lhs[rhs] */
+    NODE_CALL,          /* lhs(rhs, rhs->next, ...) */
+    NODE_POST_INC,      /* lhs++ */
+    NODE_POST_DEC,      /* lhs-- */
+    NODE_PRE_INC,       /* ++lhs */
+    NODE_PRE_DEC,       /* --lhs */
+    NODE_NEG,           /* -lhs */
+    NODE_NOT,           /* !lhs */
+    NODE_DEREF,         /* *lhs */
+    NODE_ADDR,          /* &lhs */
+    NODE_BINARY,        /* lhs op rhs, `op` is an enum binary_operator */
+    NODE_CMP,           /* lhs op rhs, `op` is an enum cmp_operator */
+    NODE_COND,          /* cond ? lhs : rhs */
+    NODE_ASSIGN,        /* lhs = rhs */
+    NODE_ASSIGN_BINARY, /* lhs =op rhs, `op` is an enum binary_operator */
+    NODE_ASSIGN_CMP,    /* lhs =op rhs, `op` is an enum cmp_operator */
+
+    /* statements */
+    NODE_NULL,          /* ; */
+    NODE_BLOCK,         /* { lhs lhs->next ... } */
+    NODE_AUTO,          /* auto lhs, lhs->next, ...; */
+    NODE_VAR,           /* one auto variable, `value` is the vector size or -1 for a scalar */
+    NODE_LABEL,         /* name: lhs, `value` numbers the labels of a function from 0 */
+    NODE_GOTO,          /* goto name; `value` is the number of the label */
+    NODE_RETURN,        /* return (lhs); or return; when lhs is NULL */
+    NODE_IF,            /* if (cond) lhs else rhs, rhs may be NULL */
+    NODE_WHILE,         /* while (cond) lhs */
+    NODE_SWITCH,        /* switch cond lhs */
+    NODE_CASE,          /* case value: lhs */
+};
+
+//
+// Node of the abstract syntax tree.
+// Any expression node can appear where a statement is expected;
+// it is then evaluated for its side effects.
+//
+struct node {
+    enum node_kind kind;
+    int op; /* operator of binary, comparison and assignment nodes */
+    intptr_t value; /* literal value, stack slot or string index */
+    const char *name; /* interned name of externals, labels and goto targets */
+
+    struct node *cond; /* condition of ?:, if, while and switch */
+    struct node *lhs; /* operand or body */
+    struct node *rhs; /* second operand or else branch */
+    struct node *next; /* next statement, call argument or auto variable */
+};
+
+//
+// Function definition.
+//
+struct function {
+    const char *name; /* interned function name */
+    size_t num_args; /* number of arguments */
+    struct node *body; /* function body statement */
+    size_t num_slots; /* most words of arguments and locals in scope at once */
+
+    size_t num_labels; /* number of if, while, switch and case statements */
+    size_t num_conds; /* number of ?: operators */
+    size_t num_named_labels; /* number of `name:` labels */
+
+    struct arena *arena; /* storage for the nodes */
+};
+
+enum definition_kind {
+    DEF_FUNCTION, /* name(args) statement */
+    DEF_SCALAR,   /* name ival, ival, ...; */
+    DEF_VECTOR,   /* name[size] ival, ival, ...; */
+};
+
+//
+// Top level definition.
+// Initial values are NODE_NUMBER, NODE_NEG of NODE_NUMBER, NODE_STRING
+// or NODE_EXTRN nodes chained through `next`.
+//
+struct definition {
+    enum definition_kind kind;
+    const char *name; /* interned name of the definition */
+
+    struct node *ivals; /* initial values of scalars and vectors */
+    intptr_t size; /* DEF_VECTOR: declared number of words */
+
+    struct function fn; /* DEF_FUNCTION */
+};
+
+#endif /* BCAUSE_AST_H */
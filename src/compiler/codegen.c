@@ -0,0 +1,587 @@
+#include "codegen.h"
+#include "irgen.h"
+#include "list.h"
+#include "opt.h"
+#include "x86.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+const char *arg_registers[MAX_FN_CALL_ARGS] = {
+    "%rdi",
+    "%rsi",
+    "%rdx",
+    "%rcx",
+    "%r8",
+    "%r9"
+};
+
+static const char* cmp_instruction[CMP_NE + 1] = {
+    "setl",
+    "setle",
+    "setg",
+    "setge",
+    "sete",
+    "setne",
+};
+
+static const char* binary_code[BIN_OR + 1] = {
+    /* + */     "  pop %rdi\n"
+                "  add %rdi, %rax\n",
+
+    /* - */     "  mov %rax, %rdi\n"
+                "  pop %rax\n"
+                "  sub %rdi, %rax\n",
+
+    /* * */     "  pop %rdi\n"
+                "  imul %rdi, %rax\n",
+
+    /* / */     "  mov %rax, %rdi\n"
+                "  pop %rax\n"
+                "  cqo\n"
+                "  idiv %rdi\n",
+
+    /* % */     "  mov %rax, %rdi\n"
+                "  pop %rax\n"
+                "  cqo\n"
+                "  idiv %rdi\n"
+                "  mov %rdx, %rax\n",
+
+    /* << */    "  mov %rax, %rcx\n"
+                "  pop %rax\n"
+                "  shl %cl, %rax\n",
+
+    /* >> */    "  mov %rax, %rcx\n"
+                "  pop %rax\n"
+                "  sar %cl, %rax\n",
+
+    /* & */     "  pop %rdi\n"
+                "  and %rdi, %rax\n",
+
+    /* | */     "  pop %rdi\n"
+                "  or %rdi, %rax\n",
+};
+
+struct codegen {
+    struct compiler_args *args;
+    FILE *out;
+    const struct function *fn;
+    uintmax_t stack_offset; /* words of locals allocated at this point */
+    struct codegen_ids *ids; /* label and string numbering */
+    const struct inliner *inl; /* functions to inline, or NULL */
+};
+
+static bool expr(struct codegen *cg, const struct node *node);
+
+//
+// Evaluate an expression into %rax, loading the value if it is an lvalue.
+//
+static void rvalue(struct codegen *cg, const struct node *node)
+{
+    if (expr(cg, node))
+        fprintf(cg->out, "  mov (%%rax), %%rax\n");
+}
+
+//
+// Generate code for binary operation.
+// Left operand is in %rax.
+//
+static void binary_expr(struct codegen *cg, enum binary_operator op, const struct node *right)
+{
+    fprintf(cg->out, "  push %%rax\n");
+    rvalue(cg, right);
+    fputs(binary_code[op], cg->out);
+}
+
+//
+// Generate code for comparison operation.
+// Left operand is in %rax.
+//
+static void cmp_expr(struct codegen *cg, enum cmp_operator op, const struct node *right)
+{
+    fprintf(cg->out, "  push %%rax\n");
+    rvalue(cg, right);
+    fprintf(cg->out,
+        "  pop %%rdi\n"
+        "  cmp %%rax, %%rdi\n"
+        "  %s %%al\n"
+        "  movzb %%al, %%rax\n",
+        cmp_instruction[op]
+    );
+}
+
+//
+// Generate code for an expression.
+// Return true when %rax holds an lvalue (address of the value).
+//
+static bool expr(struct codegen *cg, const struct node *node)
+{
+    FILE *out = cg->out;
+    const struct node *arg;
+    int num_args = 0;
+    size_t id;
+
+    switch (node->kind) {
+    case NODE_NUMBER:
+        if (node->value)
+            fprintf(out, "  mov $%lu, %%rax\n", node->value);
+        else
+            fprintf(out, "  xor %%rax, %%rax\n");
+        return false;
+
+    case NODE_STRING:
+        fprintf(out, "  lea .string.%lu(%%rip), %%rax\n", string_label(cg->ids, node->value));
+        return false;
+
+    case NODE_LOCAL:
+        fprintf(out, "  lea -%lu(%%rbp), %%rax\n", (node->value + 2) * cg->args->word_size);
+        return true;
+
+    case NODE_EXTRN:
+        fprintf(out, "  lea %s(%%rip), %%rax\n", node->name);
+        return true;
+
+    case NODE_INDEX:
+        expr(cg, node->lhs);
+        fprintf(out, "  push (%%rax)\n");
+        rvalue(cg, node->rhs);
+        fprintf(out, "  pop %%rdi\n  shl $3, %%rax\n  add %%rdi, %%rax\n");
+        return true;
+
+    case NODE_CALL:
+        expr(cg, node->lhs);
+        fprintf(out, "  push %%rax\n");
+        for (arg = node->rhs; arg; arg = arg->next) {
+            rvalue(cg, arg);
+            fprintf(out, "  push %%rax\n");
+            num_args++;
+        }
+
+        while (num_args > 0)
+            fprintf(out, "  pop %s\n", arg_registers[--num_args]);
+
+        fprintf(out, "  pop %%r10\n  call *%%r10\n");
+        return false;
+
+    case NODE_POST_INC:
+        expr(cg, node->lhs);
+        fprintf(out,
+            "  mov (%%rax), %%rcx\n"
+            "  addq $1, (%%rax)\n"
+            "  mov %%rcx, %%rax\n"
+        );
+        return false;
+
+    case NODE_POST_DEC:
+        expr(cg, node->lhs);
+        fprintf(out,
+            "  mov (%%rax), %%rcx\n"
+            "  subq $1, (%%rax)\n"
+            "  mov %%rcx, %%rax\n"
+        );
+        return false;
+
+    case NODE_PRE_INC:
+        expr(cg, node->lhs);
+        fprintf(out, "  mov (%%rax), %%rdi\n  add $1, %%rdi\n  mov %%rdi, (%%rax)\n");
+        return true;
+
+    case NODE_PRE_DEC:
+        expr(cg, node->lhs);
+        fprintf(out, "  mov (%%rax), %%rdi\n  sub $1, %%rdi\n  mov %%rdi, (%%rax)\n");
+        return true;
+
+    case NODE_NEG:
+        rvalue(cg, node->lhs);
+        fprintf(out, "  neg %%rax\n");
+        return false;
+
+    case NODE_NOT:
+        rvalue(cg, node->lhs);
+        fprintf(out, "  cmp $0, %%rax\n  sete %%al\n  movzx %%al, %%rax\n");
+        return false;
+
+    case NODE_DEREF:
+        rvalue(cg, node->lhs);
+        return true;
+
+    case NODE_ADDR:
+        expr(cg, node->lhs);
+        return false;
+
+    case NODE_BINARY:
+        rvalue(cg, node->lhs);
+        binary_expr(cg, node->op, node->rhs);
+        return false;
+
+    case NODE_CMP:
+        rvalue(cg, node->lhs);
+        cmp_expr(cg, node->op, node->rhs);
+        return false;
+
+    case NODE_COND:
+        rvalue(cg, node->cond);
+        id = cg->ids->cond_id++;
+        fprintf(out, "  cmp $0, %%rax\n  je .L.cond.else.%ld\n", id);
+        rvalue(cg, node->lhs);
+        fprintf(out, "  jmp .L.cond.end.%ld\n.L.cond.else.%ld:\n", id, id);
+        rvalue(cg, node->rhs);
+        fprintf(out, ".L.cond.end.%ld:\n", id);
+        return false;
+
+    case NODE_ASSIGN:
+    case NODE_ASSIGN_BINARY:
+    case NODE_ASSIGN_CMP:
+        expr(cg, node->lhs);
+        fprintf(out, "  push %%rax\n  mov (%%rax), %%rax\n");
+
+        if (node->kind == NODE_ASSIGN)
+            rvalue(cg, node->rhs);
+        else if (node->kind == NODE_ASSIGN_CMP)
+            cmp_expr(cg, node->op, node->rhs);
+        else
+            binary_expr(cg, node->op, node->rhs);
+
+        fprintf(out, "  pop %%rdi\n  mov %%rax, (%%rdi)\n");
+        return false;
+
+    default:
+        fprintf(stderr, "codegen: unexpected node kind %d in expression\n", node->kind);
+        exit(1);
+    }
+}
+
+//
+// Generate code for a statement.
+//
+static void statement(struct codegen *cg, const struct node *node, intptr_t switch_id, struct list *cases)
+{
+    FILE *out = cg->out;
+    const char *fn_ident = cg->fn->name;
+    const struct node *stmt, *var;
+    struct list switch_case_list;
+    uintmax_t stack_offset;
+    size_t id, i;
+
+    switch (node->kind) {
+    case NODE_NULL:
+        break;
+
+    case NODE_BLOCK:
+        // variables of the block are out of scope after it, and variables of
+        // the blocks after it take their slots
+        stack_offset = cg->stack_offset;
+        for (stmt = node->lhs; stmt; stmt = stmt->next)
+            statement(cg, stmt, switch_id, cases);
+        cg->stack_offset = stack_offset;
+        break;
+
+    case NODE_AUTO:
+        // the frame holds all locals already
+        for (var = node->lhs; var; var = var->next) {
+            if (var->value < 0) {
+                // Scalar.
+                cg->stack_offset += 1;
+            } else {
+                // Vector.
+                cg->stack_offset += var->value + 1;
+
+                // Initialize pointer.
+                fprintf(out, "  lea -%lu(%%rbp), %%rax\n", cg->stack_offset * cg->args->word_size);
+                fprintf(out, "  movq %%rax, -%lu(%%rbp)\n", (cg->stack_offset + 1) * cg->args->word_size);
+            }
+        }
+
+        // slots are numbered as the parser did
+        if (cg->stack_offset % 2)
+            cg->stack_offset++;
+        break;
+
+    case NODE_LABEL:
+        fprintf(out, ".L.label.%s.%s:\n", node->name, fn_ident);
+        statement(cg, node->lhs, switch_id, cases);
+        break;
+
+    case NODE_GOTO:
+        fprintf(out, "  jmp .L.label.%s.%s\n", node->name, fn_ident);
+        break;
+
+    case NODE_RETURN:
+        if (node->lhs)
+            rvalue(cg, node->lhs);
+        else
+            fprintf(out, "  xor %%rax, %%rax\n");
+        fprintf(out, "  jmp .L.return.%s\n", fn_ident);
+        break;
+
+    case NODE_IF:
+        id = cg->ids->stmt_id++;
+
+        rvalue(cg, node->cond);
+        fprintf(out, "  cmp $0, %%rax\n  je .L.else.%lu\n", id);
+
+        statement(cg, node->lhs, -1, NULL);
+        fprintf(out, "  jmp .L.end.%lu\n.L.else.%lu:\n", id, id);
+
+        if (node->rhs)
+            statement(cg, node->rhs, -1, NULL);
+
+        fprintf(out, ".L.end.%lu:\n", id);
+        break;
+
+    case NODE_WHILE:
+        id = cg->ids->stmt_id++;
+
+        fprintf(out, ".L.start.%lu:\n", id);
+        rvalue(cg, node->cond);
+        fprintf(out,
+            "  cmp $0, %%rax\n"
+            "  je .L.end.%lu\n",
+            id
+        );
+
+        statement(cg, node->lhs, -1, NULL);
+        fprintf(out, "  jmp .L.start.%lu\n.L.end.%lu:\n", id, id);
+        break;
+
+    case NODE_SWITCH:
+        id = cg->ids->stmt_id++;
+
+        rvalue(cg, node->cond);
+        fprintf(out, "  jmp .L.cmp.%ld\n.L.stmts.%ld:\n", id, id);
+
+        memset(&switch_case_list, 0, sizeof(struct list));
+        statement(cg, node->lhs, id, &switch_case_list);
+        fprintf(out,
+            "  jmp .L.end.%ld\n"
+            ".L.cmp.%ld:\n",
+            id, id
+        );
+
+        for (i = 0; i < switch_case_list.size; i++)
+            fprintf(out, "  cmp $%lu, %%rax\n  je .L.case.%lu.%lu\n", (uintptr_t) switch_case_list.data[i], id, (uintptr_t) switch_case_list.data[i]);
+
+        fprintf(out, ".L.end.%ld:\n", id);
+
+        list_free(&switch_case_list);
+        break;
+
+    case NODE_CASE:
+        cg->ids->stmt_id++;
+
+        list_push(cases, (void*) node->value);
+        fprintf(out, ".L.case.%ld.%lu:\n", switch_id, node->value);
+        statement(cg, node->lhs, switch_id, cases);
+        break;
+
+    default:
+        rvalue(cg, node);
+    }
+}
+
+//
+// Generate x86_64 assembly for a function definition.
+//
+static void function(struct codegen *cg, const struct function *fn)
+{
+    FILE *out = cg->out;
+    unsigned char word_size = cg->args->word_size;
+    uintmax_t words = 1 + fn->num_slots;
+    size_t i;
+
+    // a padding word and the most arguments and locals in scope at once,
+    // allocated once for the whole function
+    words += words % 2;
+    fprintf(out,
+        ".text\n"
+        ".type %s, @function\n"
+        "%s:\n"
+        "  push %%rbp\n"
+        "  mov %%rsp, %%rbp\n"
+        "  sub $%ju, %%rsp\n",
+        fn->name, fn->name, words * word_size
+    );
+
+    // spill arguments to the stack
+    for (i = 0; i < fn->num_args; i++) {
+        fprintf(out, "  mov %s, -%lu(%%rbp)\n", arg_registers[i], (cg->stack_offset + 2) * word_size);
+        cg->stack_offset++;
+    }
+
+    statement(cg, fn->body, -1, NULL);
+
+    fprintf(out,
+        "  xor %%rax, %%rax\n"
+        ".L.return.%s:\n"
+        "  mov %%rbp, %%rsp\n"
+        "  pop %%rbp\n"
+        "  ret\n",
+        fn->name
+    );
+}
+
+//
+// Generate x86_64 assembly for a function definition through the
+// intermediate code and its optimization passes.
+//
+static void optimized_function(struct codegen *cg, const struct function *fn)
+{
+    struct arena arena;
+    struct ir_function *ir;
+
+    memset(&arena, 0, sizeof(struct arena));
+    ir = ir_build(&arena, fn, cg->args->word_size);
+    optimize(ir, cg->args->opt_level, cg->inl);
+    if (cg->args->dump_ir)
+        ir_dump(stderr, ir);
+
+    x86_function(cg->args, cg->out, ir, cg->ids);
+    arena_free(&arena);
+}
+
+//
+// Emit the initial values of a global scalar or vector.
+// Return the number of words emitted.
+//
+static intptr_t ivals(struct codegen *cg, const struct node *ival)
+{
+    FILE *out = cg->out;
+    intptr_t nwords = 0;
+
+    for (; ival; ival = ival->next, nwords++) {
+        switch (ival->kind) {
+        case NODE_EXTRN:
+            fprintf(out, "  .quad %s\n", ival->name);
+            break;
+        case NODE_STRING:
+            fprintf(out, "  .quad .string.%lu\n", string_label(cg->ids, ival->value));
+            break;
+        case NODE_NEG:
+            fprintf(out, "  .quad -%lu\n", ival->lhs->value);
+            break;
+        default:
+            fprintf(out, "  .quad %lu\n", ival->value);
+        }
+    }
+    return nwords;
+}
+
+//
+// Generate x86_64 assembly for a top level definition.
+//
+void codegen_definition(struct compiler_args *args, FILE *out, const struct definition *def, struct codegen_ids *ids,
+                        const struct inliner *inl)
+{
+    struct codegen cg = { args, out, &def->fn, 0, ids, inl };
+    intptr_t nwords;
+
+    fprintf(out, ".globl %s\n", def->name);
+
+    switch (def->kind) {
+    case DEF_FUNCTION:
+        if (args->opt_level)
+            optimized_function(&cg, &def->fn);
+        else
+            function(&cg, &def->fn);
+        break;
+
+    case DEF_SCALAR:
+        fprintf(out,
+            ".data\n"
+            ".type %s, @object\n"
+            ".align %d\n"
+            "%s:\n",
+            def->name, args->word_size, def->name
+        );
+        if (!ivals(&cg, def->ivals))
+            fprintf(out, "  .zero %d\n", args->word_size);
+        break;
+
+    case DEF_VECTOR:
+        fprintf(out,
+            ".data\n.type %s, @object\n"
+            ".align %d\n"
+            "%s:\n"
+            "  .quad .+8\n",
+            def->name, args->word_size, def->name
+        );
+        nwords = def->size - ivals(&cg, def->ivals);
+        if (nwords > 0)
+            fprintf(out, "  .zero %ld\n", args->word_size * nwords);
+        break;
+    }
+}
+
+//
+// Order strings by their reversal, so that each string is directly
+// followed by the strings it is a suffix of.
+//
+static int compare_reversed(const void *a, const void *b)
+{
+    const struct intern_entry *x = *(const struct intern_entry**) a;
+    const struct intern_entry *y = *(const struct intern_entry**) b;
+    size_t i = x->len, j = y->len;
+
+    while (i > 0 && j > 0) {
+        unsigned char c = x->str[--i], d = y->str[--j];
+        if (c != d)
+            return c < d ? -1 : 1;
+    }
+    return (i > 0) - (j > 0);
+}
+
+//
+// Tell whether string `s` is a suffix of string `t`.
+//
+static bool is_suffix(const struct intern_entry *s, const struct intern_entry *t)
+{
+    return s->len <= t->len && memcmp(t->str + (t->len - s->len), s->str, s->len) == 0;
+}
+
+//
+// Create read-only section with strings.
+// Equal strings were merged by the string table already; a string that is
+// the tail of another one gets a label into the longer string's bytes.
+//
+void codegen_strings(FILE *out, const struct intern_table *strings, size_t string_base)
+{
+    const struct intern_entry **entries, **sorted, **tail_of;
+    size_t i, j, n = strings->count;
+
+    fprintf(out, ".section .rodata\n");
+    if (!n)
+        return;
+
+    entries = malloc(n * sizeof(struct intern_entry*));
+    sorted = malloc(n * sizeof(struct intern_entry*));
+    tail_of = calloc(n, sizeof(struct intern_entry*));
+    intern_entries(strings, entries);
+    memcpy(sorted, entries, n * sizeof(struct intern_entry*));
+    qsort(sorted, n, sizeof(struct intern_entry*), compare_reversed);
+
+    // find the longest string every string is a suffix of
+    for (i = n - 1; i-- > 0;) {
+        if (is_suffix(sorted[i], sorted[i + 1]))
+            tail_of[sorted[i]->index] = tail_of[sorted[i + 1]->index] ? tail_of[sorted[i + 1]->index] : sorted[i + 1];
+    }
+
+    for (i = 0; i < n; i++) {
+        if (tail_of[i]) {
+            fprintf(out, ".set .string.%lu, .string.%lu + %lu\n", string_base + i,
+                    string_base + tail_of[i]->index, tail_of[i]->len - entries[i]->len);
+            continue;
+        }
+
+        fprintf(out, ".string.%lu:\n", string_base + i);
+        for (j = 0; j < entries[i]->len; j++)
+            fprintf(out, "  .byte %u\n", entries[i]->str[j]);
+        fprintf(out, "  .byte 0\n");
+    }
+
+    free(entries);
+    free(sorted);
+    free(tail_of);
+}
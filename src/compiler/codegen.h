@@ -0,0 +1,54 @@
+#ifndef BCAUSE_CODEGEN_H
+#define BCAUSE_CODEGEN_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "compiler.h"
+#include "intern.h"
+#include "list.h"
+
+#define MAX_FN_CALL_ARGS 6
+
+//
+// Numbering of labels and strings.
+// Label ids are taken in order as code is generated, so generating the
+// definitions of a file in source order always yields the same labels.
+//
+struct codegen_ids {
+    size_t stmt_id; /* next id for if, while, switch and case labels */
+    size_t cond_id; /* next id for ?: labels */
+    size_t string_base; /* global index of the first string of the current string table */
+    const size_t *string_labels; /* label numbers of the strings, if not counted from string_base */
+};
+
+//
+// Registers the arguments of a call are passed in.
+//
+extern const char *arg_registers[MAX_FN_CALL_ARGS];
+
+//
+// Return the label number of a string of the string table.
+//
+static inline size_t string_label(const struct codegen_ids *ids, intptr_t index)
+{
+    if (ids->string_labels)
+        return ids->string_labels[index];
+    return ids->string_base + index;
+}
+
+struct inliner;
+
+//
+// Generate x86_64 assembly for a top level definition.
+// Functions that `inl` keeps are inlined if it is not NULL.
+//
+void codegen_definition(struct compiler_args *args, FILE *out, const struct definition *def, struct codegen_ids *ids,
+                        const struct inliner *inl);
+
+//
+// Create read-only section with strings.
+//
+void codegen_strings(FILE *out, const struct intern_table *strings, size_t string_base);
+
+#endif /* BCAUSE_CODEGEN_H */
@@ -1,11 +1,15 @@
 #ifndef BCAUSE_COMPILER_H
 #define BCAUSE_COMPILER_H
 
+#include <setjmp.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "arena.h"
+#include "intern.h"
 #include "list.h"
+#include "symtab.h"
 
 #define A_OUT "a.out"
 #define A_S   "a.s"
@@ -19,11 +23,15 @@
 
 #define X86_64_WORD_SIZE sizeof(intptr_t)
 
+#define MAX_OPT_LEVEL 2
+#define DEFAULT_INLINE_LIMIT 16
+
+struct source;
+struct chunk;
+
 struct compiler_pos {
-    // TODO: 'whitespace' skips line before checking for semicolon,
-    // so displaying errors expecting semicolons may show wrong line.
-    const char *file_name;
-    size_t line;
+    struct source *src; /* file being compiled */
+    size_t offset; /* byte offset into the source; turned into a line only when printed */
 };
 
 struct compiler_args {
@@ -38,14 +46,34 @@ struct compiler_args {
     bool do_linking;    /* should the compiler link? */
     bool do_assembling; /* should the compiler assemble? */
     bool save_temps;    /* should temporary files get deleted? */
+    bool mem_report;    /* should peak memory use be printed? */
+    bool dump_ir;       /* should the intermediate code be printed? */
+
+    unsigned char opt_level; /* 0 runs the stack machine, higher levels the optimizer */
+    unsigned inline_limit; /* largest function inlined at -O2, in instructions; 0 disables inlining */
+
+    unsigned jobs; /* number of threads compiling a file */
+};
 
+//
+// Mutable state of one compilation.
+// `struct compiler_args` is only read while compiling; everything that
+// changes lives here, and every thread parsing source code has its own
+// context. Several compilations can thus run side by side in one process.
+//
+struct compiler_ctx {
     struct compiler_pos pos; /* current position in the source code */
 
-    struct list locals; /* local variables */
+    struct symtab symbols; /* local and extrn names */
+    struct symtab labels; /* labels of the current function, by number */
+    struct list gotos; /* goto statements of the current function */
     uintmax_t stack_offset; /* local variable offset */
-    struct list extrns; /* extrn variables */
 
-    struct list strings; /* string table */
+    struct intern_table strings; /* string table, numbered in order of appearance */
+    struct arena arena; /* syntax trees, released after code generation */
+
+    struct chunk *chunk; /* piece of the file compiled by a worker thread, if any */
+    jmp_buf error; /* where compile_error() abandons the compilation */
 };
 
 #ifdef __GNUC__
@@ -53,6 +81,15 @@ __attribute((format(printf, 2, 3)))
 #endif
 void eprintf(const char *arg0, const char *fmt, ...);
 
+//
+// Report an error at the current source position and abandon the
+// compilation by jumping back to `ctx->error`.
+//
+#ifdef __GNUC__
+__attribute((format(printf, 2, 3), noreturn))
+#endif
+void compile_error(struct compiler_ctx *ctx, const char *fmt, ...);
+
 int compile(struct compiler_args *args);
 
 #endif
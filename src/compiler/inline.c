@@ -0,0 +1,400 @@
+#include "inline.h"
+#include "irgen.h"
+#include "list.h"
+#include "opt.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INLINER_INIT_CAPACITY 64
+
+//
+// Functions whose intermediate code before optimization has more than this
+// many instructions per instruction of the limit are not even optimized
+// to find out whether they are small enough.
+//
+#define INLINE_BUILD_FACTOR 8
+
+//
+// Most instructions that inlining may add to one function in one round.
+//
+#define INLINE_BUDGET 1000
+
+struct inline_candidate {
+    const char *name; /* NULL for a free entry */
+    struct ir_function *fn;
+    unsigned cost;
+};
+
+static size_t hash_name(const char *name)
+{
+    size_t h = 5381;
+
+    while (*name)
+        h = h * 33 + (unsigned char) *name++;
+    return h;
+}
+
+//
+// Return the entry of the table for `name`, which is free if it is not there.
+//
+static struct inline_candidate *find(const struct inliner *inl, const char *name)
+{
+    size_t i = hash_name(name) & (inl->capacity - 1);
+
+    while (inl->table[i].name && strcmp(inl->table[i].name, name))
+        i = (i + 1) & (inl->capacity - 1);
+    return &inl->table[i];
+}
+
+static void grow(struct inliner *inl)
+{
+    struct inline_candidate *old = inl->table, *entry;
+    size_t i, capacity = inl->capacity;
+
+    inl->capacity = capacity * 2;
+    inl->table = calloc(inl->capacity, sizeof(struct inline_candidate));
+    for (i = 0; i < capacity; i++) {
+        if (old[i].name) {
+            entry = find(inl, old[i].name);
+            *entry = old[i];
+        }
+    }
+    free(old);
+}
+
+void inliner_init(struct inliner *inl, const struct compiler_args *args)
+{
+    memset(inl, 0, sizeof(struct inliner));
+    inl->args = args;
+    inl->capacity = INLINER_INIT_CAPACITY;
+    inl->table = calloc(inl->capacity, sizeof(struct inline_candidate));
+}
+
+void inliner_free(struct inliner *inl)
+{
+    arena_free(&inl->arena);
+    arena_free(&inl->scratch);
+    free(inl->table);
+}
+
+//
+// Count the instructions a function costs where it is inlined: the values
+// that are only operands and the jumps that merging blocks removes are free.
+//
+static unsigned cost(const struct ir_function *fn)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+    unsigned n = 0;
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            switch (inst->op) {
+            case IR_CONST:
+            case IR_STRING:
+            case IR_GLOBAL:
+            case IR_SLOT:
+            case IR_PARAM:
+            case IR_PHI:
+            case IR_JMP:
+                break;
+            default:
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+//
+// Copying the body of a function into another one.
+//
+struct copy {
+    struct ir_function *fn; /* function copied into */
+    const struct ir_function *src; /* function copied */
+    struct ir_inst **values; /* copy of each value of `src`, by id */
+    struct ir_block **blocks; /* copy of each block of `src`, by id */
+    const struct ir_block **sources; /* block of `src` each new block copies */
+    unsigned first_block; /* id of the first new block */
+};
+
+//
+// Copy the blocks of `c->src` to the end of the layout of `c->fn`.
+// Arguments are replaced with the values `args` if they are given, and
+// returns with jumps to `exit`, the returned values going to `results`,
+// if that is given. Slot numbers, and those calls leave free, are moved
+// up by `slot_base`.
+//
+static void copy_body(struct copy *c, struct ir_inst *const *args, unsigned num_args, uintmax_t slot_base,
+                      struct ir_block *exit, struct list *results)
+{
+    struct ir_function *fn = c->fn;
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+    struct ir_block *copy;
+    struct ir_inst *value, *zero = NULL;
+    unsigned i;
+    int j;
+
+    c->values = calloc(c->src->num_insts, sizeof(struct ir_inst*));
+    c->blocks = calloc(c->src->num_blocks, sizeof(struct ir_block*));
+    c->sources = calloc(c->src->num_blocks, sizeof(struct ir_block*));
+    c->first_block = fn->num_blocks;
+
+    for (bb = c->src->entry; bb; bb = bb->next) {
+        c->blocks[bb->id] = ir_new_block(fn);
+        c->sources[c->blocks[bb->id]->id - c->first_block] = bb;
+    }
+
+    // the values first, as operands may be defined later in the layout
+    for (bb = c->src->entry; bb; bb = bb->next) {
+        copy = c->blocks[bb->id];
+        for (inst = bb->first; inst != bb->last; inst = inst->next) {
+            if (inst->op == IR_PARAM && args) {
+                if (inst->imm < num_args)
+                    c->values[inst->id] = args[inst->imm];
+                else {
+                    // missing arguments are whatever the registers held
+                    if (!zero)
+                        zero = ir_emit(fn, copy, IR_CONST);
+                    c->values[inst->id] = zero;
+                }
+                continue;
+            }
+
+            value = ir_new_inst(fn, inst->op);
+            value->imm = inst->op == IR_SLOT || inst->op == IR_CALL ? inst->imm + (intptr_t) slot_base : inst->imm;
+            value->name = inst->name;
+            value->vector = inst->vector;
+            ir_append(copy, value);
+            c->values[inst->id] = value;
+        }
+    }
+
+    for (bb = c->src->entry; bb; bb = bb->next) {
+        copy = c->blocks[bb->id];
+        for (inst = bb->first; inst != bb->last; inst = inst->next)
+            if (inst->op != IR_PHI && (inst->op != IR_PARAM || !args))
+                for (i = 0; i < inst->num_args; i++)
+                    ir_add_arg(fn, c->values[inst->id], c->values[inst->args[i].value->id]);
+
+        inst = bb->last;
+        switch (inst->op) {
+        case IR_JMP:
+            ir_jmp(fn, copy, c->blocks[bb->succs[0]->id]);
+            break;
+        case IR_BR:
+            ir_br(fn, copy, c->values[inst->args[0].value->id], c->blocks[bb->succs[0]->id], c->blocks[bb->succs[1]->id]);
+            break;
+        case IR_SWITCH:
+            ir_switch(fn, copy, c->values[inst->args[0].value->id], bb->num_succs - 1);
+            ir_set_case(fn, copy, -1, 0, c->blocks[bb->succs[0]->id]);
+            for (i = 1; i < bb->num_succs; i++)
+                ir_set_case(fn, copy, i - 1, inst->cases[i], c->blocks[bb->succs[i]->id]);
+            break;
+        default:
+            if (exit) {
+                list_push(results, c->values[inst->args[0].value->id]);
+                ir_jmp(fn, copy, exit);
+            }
+            else
+                ir_ret(fn, copy, c->values[inst->args[0].value->id]);
+        }
+    }
+
+    // the edges of the copies may be in another order than the original ones
+    for (bb = c->src->entry; bb; bb = bb->next) {
+        copy = c->blocks[bb->id];
+        for (inst = bb->first, value = copy->first; inst->op == IR_PHI; inst = inst->next, value = value->next) {
+            for (i = 0; i < copy->num_preds; i++) {
+                j = ir_pred_index(bb, c->sources[copy->preds[i]->id - c->first_block]);
+                ir_add_arg(fn, value, c->values[inst->args[j].value->id]);
+            }
+        }
+    }
+}
+
+static void free_copy(struct copy *c)
+{
+    free(c->values);
+    free(c->blocks);
+    free(c->sources);
+}
+
+//
+// Tell whether a function can be inlined at all. Slots below zero, which
+// `auto v[]` leaves, would overlap with the slots of the caller.
+//
+static bool can_inline(const struct ir_function *fn)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (inst->op == IR_SLOT && inst->imm < 0)
+                return false;
+    return true;
+}
+
+void inliner_add(struct inliner *inl, const struct function *fn, const struct codegen_ids *ids)
+{
+    struct ir_function *ir, *body;
+    struct inline_candidate *entry;
+    struct ir_block *bb;
+    struct ir_inst *inst;
+    struct copy c;
+    char label[64];
+    unsigned n;
+
+    arena_reset(&inl->scratch);
+    ir = ir_build(&inl->scratch, fn, inl->args->word_size);
+    if (ir->num_insts > (uintmax_t) inl->args->inline_limit * INLINE_BUILD_FACTOR)
+        return;
+    optimize(ir, inl->args->opt_level, NULL);
+    if ((n = cost(ir)) > inl->args->inline_limit || !can_inline(ir))
+        return;
+
+    body = ir_new_function(&inl->arena, NULL, ir->num_args, ir->word_size);
+    body->name = arena_alloc(&inl->arena, strlen(fn->name) + 1);
+    strcpy((char*) body->name, fn->name);
+    body->num_slots = ir->num_slots;
+
+    memset(&c, 0, sizeof(struct copy));
+    c.fn = body;
+    c.src = ir;
+    copy_body(&c, NULL, 0, 0, NULL, NULL);
+    free_copy(&c);
+
+    // strings are numbered by the part of the file they are in, so they are
+    // referred to by their labels, like globals
+    for (bb = body->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (inst->op != IR_STRING)
+                continue;
+            sprintf(label, ".string.%zu", string_label(ids, inst->imm));
+            inst->op = IR_GLOBAL;
+            inst->name = arena_alloc(&inl->arena, strlen(label) + 1);
+            strcpy((char*) inst->name, label);
+        }
+    }
+
+    if (2 * (inl->count + 1) > inl->capacity)
+        grow(inl);
+    entry = find(inl, body->name);
+    if (!entry->name)
+        inl->count++;
+    entry->name = body->name;
+    entry->fn = body;
+    entry->cost = n;
+}
+
+//
+// Replace `call` with the body of `callee`: the block of the call is split
+// after it, and the blocks of the callee go in between.
+//
+static void inline_call(struct ir_function *fn, struct ir_inst *call, const struct ir_function *callee)
+{
+    struct ir_block *bb = call->block, *rest = ir_new_block(fn), *pos, *copy, *succ;
+    const struct ir_block *src;
+    struct ir_inst *inst, *next, *result, *args[MAX_FN_CALL_ARGS];
+    struct list results = { 0 };
+    struct copy c;
+    unsigned i, j, num_args = call->num_args - 1;
+
+    if (num_args > MAX_FN_CALL_ARGS)
+        num_args = MAX_FN_CALL_ARGS;
+
+    // what follows the call goes to a block of its own
+    for (inst = call->next; inst; inst = next) {
+        next = inst->next;
+        ir_unlink(inst);
+        ir_append(rest, inst);
+    }
+    rest->succs = bb->succs;
+    rest->num_succs = bb->num_succs;
+    for (i = 0; i < rest->num_succs; i++) {
+        succ = rest->succs[i];
+        for (j = 0; j < succ->num_preds; j++)
+            if (succ->preds[j] == bb)
+                succ->preds[j] = rest;
+    }
+    bb->succs = NULL;
+    bb->num_succs = 0;
+
+    for (i = 0; i < num_args; i++)
+        args[i] = call->args[i + 1].value;
+
+    memset(&c, 0, sizeof(struct copy));
+    c.fn = fn;
+    c.src = callee;
+    // the frame of the callee goes above the slots in use at the call, and
+    // is shared with those of the other calls
+    copy_body(&c, args, num_args, call->imm, rest, &results);
+    ir_jmp(fn, bb, c.blocks[callee->entry->id]);
+    if (fn->num_slots < call->imm + callee->num_slots)
+        fn->num_slots = call->imm + callee->num_slots;
+
+    if (results.size == 1)
+        result = results.data[0];
+    else if (results.size) {
+        result = ir_emit(fn, rest, IR_PHI);
+        for (i = 0; i < results.size; i++)
+            ir_add_arg(fn, result, results.data[i]);
+    }
+    else
+        result = ir_emit(fn, rest, IR_CONST); /* the callee never returns */
+    ir_replace_uses(call, result);
+    ir_remove(call);
+
+    // lay the body out between the two halves of the block
+    pos = bb;
+    for (src = callee->entry; src; src = src->next) {
+        copy = c.blocks[src->id];
+        ir_move_block_after(fn, copy, pos);
+        pos = copy;
+    }
+    ir_move_block_after(fn, rest, pos);
+
+    free_copy(&c);
+    list_free(&results);
+}
+
+bool inline_calls(struct ir_function *fn, const struct inliner *inl)
+{
+    const struct inline_candidate *candidate;
+    const struct ir_inst *callee;
+    struct ir_block *bb;
+    struct ir_inst *inst;
+    struct list calls = { 0 }, callees = { 0 };
+    unsigned budget = INLINE_BUDGET;
+    size_t i;
+
+    if (!inl || !inl->count)
+        return false;
+
+    // the calls are collected first, as inlining changes the blocks
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (inst->op != IR_CALL || (callee = inst->args[0].value)->op != IR_GLOBAL)
+                continue;
+            if (!strcmp(callee->name, fn->name) || !(candidate = find(inl, callee->name))->name)
+                continue;
+            if (candidate->cost > budget)
+                continue;
+            budget -= candidate->cost;
+            list_push(&calls, inst);
+            list_push(&callees, candidate->fn);
+        }
+    }
+
+    for (i = 0; i < calls.size; i++)
+        inline_call(fn, calls.data[i], callees.data[i]);
+
+    list_free(&calls);
+    list_free(&callees);
+    return i > 0;
+}
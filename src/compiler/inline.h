@@ -0,0 +1,52 @@
+#ifndef BCAUSE_INLINE_H
+#define BCAUSE_INLINE_H
+
+#include <stdbool.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "codegen.h"
+#include "compiler.h"
+#include "ir.h"
+
+struct inline_candidate;
+
+//
+// Bodies of the functions of a file that are small enough to be inlined,
+// each optimized on its own. Once all functions are added, the bodies are
+// only read, so threads generating code can share them.
+//
+struct inliner {
+    const struct compiler_args *args;
+    struct arena arena; /* storage for the bodies */
+    struct arena scratch; /* storage for a function being looked at */
+
+    struct inline_candidate *table; /* hash table by name */
+    size_t capacity, count;
+};
+
+void inliner_init(struct inliner *inl, const struct compiler_args *args);
+void inliner_free(struct inliner *inl);
+
+//
+// Optimize a function definition and keep its body if it is small enough.
+// `ids` gives the labels of the strings it uses.
+//
+void inliner_add(struct inliner *inl, const struct function *fn, const struct codegen_ids *ids);
+
+//
+// Replace the calls of `fn` to functions kept by `inl` with their bodies,
+// except for calls of `fn` itself. Return whether there were any.
+//
+bool inline_calls(struct ir_function *fn, const struct inliner *inl);
+
+//
+// Tell whether a compilation inlines functions, and thus needs all
+// definitions of a file before generating code for any of them.
+//
+static inline bool inlining(const struct compiler_args *args)
+{
+    return args->opt_level >= 2 && args->inline_limit > 0;
+}
+
+#endif /* BCAUSE_INLINE_H */
@@ -0,0 +1,125 @@
+#include "intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_INIT_CAPACITY 256
+#define INTERN_BLOCK_SIZE 4096
+
+//
+// FNV-1a hash of a byte string.
+//
+uint32_t intern_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    while (len--) {
+        hash ^= (unsigned char) *str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//
+// Copy a string into the table's storage blocks.
+//
+static const char *intern_store(struct intern_table *table, const char *str, size_t len)
+{
+    char *copy;
+    size_t size = len + 1;
+
+    if (size > table->pool_left) {
+        size_t block_size = size > INTERN_BLOCK_SIZE ? size : INTERN_BLOCK_SIZE;
+        table->pool = malloc(block_size);
+        table->pool_left = block_size;
+        list_push(&table->blocks, table->pool);
+    }
+
+    copy = table->pool;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    table->pool += size;
+    table->pool_left -= size;
+    return copy;
+}
+
+//
+// Double the number of slots and re-insert all entries.
+//
+static void intern_grow(struct intern_table *table)
+{
+    struct intern_entry *old = table->slots;
+    size_t old_capacity = table->capacity, i, j;
+
+    table->capacity = old_capacity ? old_capacity * 2 : INTERN_INIT_CAPACITY;
+    table->slots = calloc(table->capacity, sizeof(struct intern_entry));
+
+    for (i = 0; i < old_capacity; i++) {
+        if (!old[i].str)
+            continue;
+        for (j = old[i].hash & (table->capacity - 1); table->slots[j].str; j = (j + 1) & (table->capacity - 1));
+        table->slots[j] = old[i];
+    }
+
+    free(old);
+}
+
+//
+// Return the entry of the given string, adding it if necessary.
+//
+const struct intern_entry *intern_add(struct intern_table *table, const char *str, size_t len)
+{
+    uint32_t hash = intern_hash(str, len);
+    struct intern_entry *entry;
+    size_t i;
+
+    if ((table->count + 1) * 4 > table->capacity * 3)
+        intern_grow(table);
+
+    for (i = hash & (table->capacity - 1);; i = (i + 1) & (table->capacity - 1)) {
+        entry = &table->slots[i];
+        if (!entry->str)
+            break;
+        if (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0)
+            return entry;
+    }
+
+    entry->str = intern_store(table, str, len);
+    entry->len = len;
+    entry->hash = hash;
+    entry->index = table->count++;
+    return entry;
+}
+
+//
+// Return the unique copy of the given string, adding it if necessary.
+//
+const char *intern(struct intern_table *table, const char *str, size_t len)
+{
+    return intern_add(table, str, len)->str;
+}
+
+//
+// Release all interned strings.
+//
+void intern_free(struct intern_table *table)
+{
+    size_t i;
+
+    for (i = 0; i < table->blocks.size; i++)
+        free(table->blocks.data[i]);
+    list_free(&table->blocks);
+    free(table->slots);
+    memset(table, 0, sizeof(struct intern_table));
+}
+
+//
+// Fill `entries` with all entries of the table, ordered by index.
+//
+void intern_entries(const struct intern_table *table, const struct intern_entry **entries)
+{
+    size_t i;
+
+    for (i = 0; i < table->capacity; i++)
+        if (table->slots[i].str)
+            entries[table->slots[i].index] = &table->slots[i];
+}
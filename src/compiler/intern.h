@@ -0,0 +1,38 @@
+#ifndef BCAUSE_INTERN_H
+#define BCAUSE_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+
+struct intern_entry {
+    const char *str; /* interned, null-terminated copy */
+    size_t len; /* length of `str` */
+    uint32_t hash; /* cached hash of `str` */
+    size_t index; /* number of strings added before this one */
+};
+
+//
+// Set of unique strings.
+// Equal strings are interned to the same pointer, so interned strings
+// can be compared with `==`.
+//
+struct intern_table {
+    struct intern_entry *slots; /* open-addressing hash table */
+    size_t capacity; /* number of slots, always a power of two */
+    size_t count; /* number of occupied slots */
+
+    char *pool; /* current block of string storage */
+    size_t pool_left; /* bytes left in the current block */
+    struct list blocks; /* all blocks of string storage */
+};
+
+uint32_t intern_hash(const char *str, size_t len);
+
+const char *intern(struct intern_table *table, const char *str, size_t len);
+const struct intern_entry *intern_add(struct intern_table *table, const char *str, size_t len);
+void intern_entries(const struct intern_table *table, const struct intern_entry **entries);
+void intern_free(struct intern_table *table);
+
+#endif /* BCAUSE_INTERN_H */
@@ -0,0 +1,642 @@
+#include "ir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *op_names[IR_RET + 1] = {
+    "const", "string", "global", "slot", "param",
+    "add", "sub", "mul", "div", "mod", "shl", "sar", "and", "or",
+    "lt", "le", "gt", "ge", "eq", "ne",
+    "neg",
+    "load", "store", "call", "phi",
+    "jmp", "br", "switch", "ret",
+};
+
+struct ir_function *ir_new_function(struct arena *arena, const char *name, unsigned num_args, unsigned char word_size)
+{
+    struct ir_function *fn = arena_alloc(arena, sizeof(struct ir_function));
+
+    fn->name = name;
+    fn->num_args = num_args;
+    fn->word_size = word_size;
+    fn->arena = arena;
+    return fn;
+}
+
+struct ir_block *ir_new_block(struct ir_function *fn)
+{
+    struct ir_block *bb = arena_alloc(fn->arena, sizeof(struct ir_block));
+
+    bb->id = fn->num_blocks++;
+    bb->prev = fn->exit;
+    if (fn->exit)
+        fn->exit->next = bb;
+    else
+        fn->entry = bb;
+    fn->exit = bb;
+    return bb;
+}
+
+struct ir_inst *ir_new_inst(struct ir_function *fn, enum ir_op op)
+{
+    struct ir_inst *inst = arena_alloc(fn->arena, sizeof(struct ir_inst));
+
+    inst->op = op;
+    inst->id = fn->num_insts++;
+    return inst;
+}
+
+void ir_insert_before(struct ir_inst *pos, struct ir_inst *inst)
+{
+    struct ir_block *bb = pos->block;
+
+    inst->block = bb;
+    inst->next = pos;
+    inst->prev = pos->prev;
+    if (pos->prev)
+        pos->prev->next = inst;
+    else
+        bb->first = inst;
+    pos->prev = inst;
+}
+
+void ir_append(struct ir_block *bb, struct ir_inst *inst)
+{
+    inst->block = bb;
+    inst->next = NULL;
+    inst->prev = bb->last;
+    if (bb->last)
+        bb->last->next = inst;
+    else
+        bb->first = inst;
+    bb->last = inst;
+}
+
+void ir_unlink(struct ir_inst *inst)
+{
+    struct ir_block *bb = inst->block;
+
+    if (inst->prev)
+        inst->prev->next = inst->next;
+    else
+        bb->first = inst->next;
+    if (inst->next)
+        inst->next->prev = inst->prev;
+    else
+        bb->last = inst->prev;
+    inst->prev = inst->next = NULL;
+    inst->block = NULL;
+}
+
+struct ir_inst *ir_emit(struct ir_function *fn, struct ir_block *bb, enum ir_op op)
+{
+    struct ir_inst *inst = ir_new_inst(fn, op), *pos;
+
+    if (op == IR_PHI) {
+        for (pos = bb->first; pos && pos->op == IR_PHI; pos = pos->next);
+        if (pos)
+            ir_insert_before(pos, inst);
+        else
+            ir_append(bb, inst);
+    }
+    else if (bb->last && ir_is_terminator(bb->last->op) && !ir_is_terminator(op))
+        ir_insert_before(bb->last, inst);
+    else
+        ir_append(bb, inst);
+    return inst;
+}
+
+struct ir_inst *ir_emit_imm(struct ir_function *fn, struct ir_block *bb, enum ir_op op, intptr_t imm)
+{
+    struct ir_inst *inst = ir_emit(fn, bb, op);
+
+    inst->imm = imm;
+    return inst;
+}
+
+struct ir_inst *ir_emit_unary(struct ir_function *fn, struct ir_block *bb, enum ir_op op, struct ir_inst *a)
+{
+    struct ir_inst *inst = ir_emit(fn, bb, op);
+
+    ir_add_arg(fn, inst, a);
+    return inst;
+}
+
+struct ir_inst *ir_emit_binary(struct ir_function *fn, struct ir_block *bb, enum ir_op op, struct ir_inst *a, struct ir_inst *b)
+{
+    struct ir_inst *inst = ir_emit(fn, bb, op);
+
+    ir_add_arg(fn, inst, a);
+    ir_add_arg(fn, inst, b);
+    return inst;
+}
+
+//
+// Chain a use into the uses of its value.
+//
+static void link_use(struct ir_use *use)
+{
+    use->prev = NULL;
+    use->next = use->value->uses;
+    if (use->next)
+        use->next->prev = use;
+    use->value->uses = use;
+}
+
+static void unlink_use(struct ir_use *use)
+{
+    if (use->prev)
+        use->prev->next = use->next;
+    else
+        use->value->uses = use->next;
+    if (use->next)
+        use->next->prev = use->prev;
+}
+
+void ir_add_arg(struct ir_function *fn, struct ir_inst *inst, struct ir_inst *value)
+{
+    struct ir_use *args;
+    unsigned i;
+
+    if (inst->num_args == inst->max_args) {
+        inst->max_args = inst->max_args ? inst->max_args * 2 : 2;
+        args = arena_alloc(fn->arena, inst->max_args * sizeof(struct ir_use));
+        for (i = 0; i < inst->num_args; i++) {
+            unlink_use(&inst->args[i]);
+            args[i] = inst->args[i];
+            link_use(&args[i]);
+        }
+        inst->args = args;
+    }
+
+    inst->args[inst->num_args].value = value;
+    inst->args[inst->num_args].user = inst;
+    link_use(&inst->args[inst->num_args++]);
+}
+
+void ir_set_arg(struct ir_inst *inst, unsigned i, struct ir_inst *value)
+{
+    unlink_use(&inst->args[i]);
+    inst->args[i].value = value;
+    link_use(&inst->args[i]);
+}
+
+void ir_remove_arg(struct ir_inst *inst, unsigned i)
+{
+    unlink_use(&inst->args[i]);
+    for (inst->num_args--; i < inst->num_args; i++) {
+        unlink_use(&inst->args[i + 1]);
+        inst->args[i] = inst->args[i + 1];
+        link_use(&inst->args[i]);
+    }
+}
+
+void ir_replace_uses(struct ir_inst *old, struct ir_inst *value)
+{
+    struct ir_use *use;
+
+    while ((use = old->uses)) {
+        unlink_use(use);
+        use->value = value;
+        link_use(use);
+    }
+}
+
+void ir_remove(struct ir_inst *inst)
+{
+    unsigned i;
+
+    for (i = 0; i < inst->num_args; i++)
+        unlink_use(&inst->args[i]);
+    inst->num_args = 0;
+    ir_unlink(inst);
+}
+
+//
+// Add an edge from `bb` to `target`.
+//
+static void add_edge(struct ir_function *fn, struct ir_block *bb, unsigned i, struct ir_block *target)
+{
+    struct ir_block **preds;
+
+    bb->succs[i] = target;
+    if (target->num_preds == target->max_preds) {
+        target->max_preds = target->max_preds ? target->max_preds * 2 : 2;
+        preds = arena_alloc(fn->arena, target->max_preds * sizeof(struct ir_block*));
+        if (target->num_preds)
+            memcpy(preds, target->preds, target->num_preds * sizeof(struct ir_block*));
+        target->preds = preds;
+    }
+    target->preds[target->num_preds++] = bb;
+}
+
+//
+// Give a block room for its outgoing edges.
+//
+static void alloc_succs(struct ir_function *fn, struct ir_block *bb, unsigned n)
+{
+    bb->num_succs = n;
+    bb->succs = arena_alloc(fn->arena, n * sizeof(struct ir_block*));
+}
+
+void ir_jmp(struct ir_function *fn, struct ir_block *bb, struct ir_block *target)
+{
+    ir_emit(fn, bb, IR_JMP);
+    alloc_succs(fn, bb, 1);
+    add_edge(fn, bb, 0, target);
+}
+
+void ir_br(struct ir_function *fn, struct ir_block *bb, struct ir_inst *cond, struct ir_block *then, struct ir_block *other)
+{
+    ir_emit_unary(fn, bb, IR_BR, cond);
+    alloc_succs(fn, bb, 2);
+    add_edge(fn, bb, 0, then);
+    add_edge(fn, bb, 1, other);
+}
+
+void ir_ret(struct ir_function *fn, struct ir_block *bb, struct ir_inst *value)
+{
+    ir_emit_unary(fn, bb, IR_RET, value);
+}
+
+//
+// The successors of a switch are filled in by ir_set_case().
+//
+struct ir_inst *ir_switch(struct ir_function *fn, struct ir_block *bb, struct ir_inst *value, unsigned num_cases)
+{
+    struct ir_inst *inst = ir_emit_unary(fn, bb, IR_SWITCH, value);
+
+    inst->cases = arena_alloc(fn->arena, (num_cases + 1) * sizeof(intptr_t));
+    alloc_succs(fn, bb, num_cases + 1);
+    return inst;
+}
+
+void ir_set_case(struct ir_function *fn, struct ir_block *bb, unsigned i, intptr_t value, struct ir_block *target)
+{
+    bb->last->cases[i + 1] = value;
+    add_edge(fn, bb, i + 1, target);
+}
+
+void ir_make_jmp(struct ir_function *fn, struct ir_block *bb, unsigned i)
+{
+    struct ir_block *target = bb->succs[i];
+    unsigned j;
+
+    // with several edges to one block, the phi operands of all of them are equal
+    for (j = 0; j < bb->num_succs; j++)
+        if (j != i)
+            ir_remove_pred(bb->succs[j], ir_pred_index(bb->succs[j], bb));
+
+    bb->succs[0] = target;
+    bb->num_succs = 1;
+    ir_remove(bb->last);
+    ir_emit(fn, bb, IR_JMP);
+}
+
+void ir_remove_pred(struct ir_block *bb, unsigned i)
+{
+    struct ir_inst *phi;
+
+    ir_foreach_phi(phi, bb)
+        ir_remove_arg(phi, i);
+    memmove(&bb->preds[i], &bb->preds[i + 1], (bb->num_preds - i - 1) * sizeof(struct ir_block*));
+    bb->num_preds--;
+}
+
+int ir_pred_index(const struct ir_block *bb, const struct ir_block *pred)
+{
+    unsigned i;
+
+    for (i = 0; i < bb->num_preds; i++)
+        if (bb->preds[i] == pred)
+            return i;
+    return -1;
+}
+
+void ir_retarget(struct ir_function *fn, struct ir_block *bb, unsigned i, struct ir_block *target, struct ir_inst **values)
+{
+    struct ir_block *old = bb->succs[i];
+    struct ir_inst *phi;
+
+    ir_remove_pred(old, ir_pred_index(old, bb));
+    add_edge(fn, bb, i, target);
+    ir_foreach_phi(phi, target)
+        ir_add_arg(fn, phi, *values++);
+}
+
+void ir_remove_block(struct ir_function *fn, struct ir_block *bb)
+{
+    struct ir_inst *inst;
+    unsigned i, j;
+
+    for (i = 0; i < bb->num_succs; i++)
+        if (bb->succs[i])
+            ir_remove_pred(bb->succs[i], ir_pred_index(bb->succs[i], bb));
+    bb->num_succs = 0;
+
+    // the blocks that still lead here go as well, and must not come back
+    for (i = 0; i < bb->num_preds; i++)
+        for (j = 0; j < bb->preds[i]->num_succs; j++)
+            if (bb->preds[i]->succs[j] == bb)
+                bb->preds[i]->succs[j] = NULL;
+    bb->num_preds = 0;
+
+    for (inst = bb->first; inst; inst = inst->next) {
+        for (i = 0; i < inst->num_args; i++)
+            unlink_use(&inst->args[i]);
+        inst->num_args = 0;
+        inst->block = NULL;
+    }
+
+    if (bb->prev)
+        bb->prev->next = bb->next;
+    else
+        fn->entry = bb->next;
+    if (bb->next)
+        bb->next->prev = bb->prev;
+    else
+        fn->exit = bb->prev;
+    bb->prev = bb->next = NULL;
+}
+
+void ir_move_block_after(struct ir_function *fn, struct ir_block *bb, struct ir_block *pos)
+{
+    if (pos == bb || pos->next == bb)
+        return;
+
+    // take it out
+    if (bb->prev)
+        bb->prev->next = bb->next;
+    else
+        fn->entry = bb->next;
+    if (bb->next)
+        bb->next->prev = bb->prev;
+    else
+        fn->exit = bb->prev;
+
+    // and put it back
+    bb->prev = pos;
+    bb->next = pos->next;
+    if (pos->next)
+        pos->next->prev = bb;
+    else
+        fn->exit = bb;
+    pos->next = bb;
+}
+
+struct ir_block *ir_split_edge(struct ir_function *fn, struct ir_block *bb, unsigned i)
+{
+    struct ir_block *succ = bb->succs[i], *split = ir_new_block(fn);
+
+    // the new block takes over the predecessor's entry of `succ`, so the
+    // phi operands stay where they are
+    ir_emit(fn, split, IR_JMP);
+    alloc_succs(fn, split, 1);
+    split->succs[0] = succ;
+    succ->preds[ir_pred_index(succ, bb)] = split;
+    bb->succs[i] = NULL;
+    add_edge(fn, bb, i, split);
+    return split;
+}
+
+void ir_split_critical_edges(struct ir_function *fn)
+{
+    struct ir_block *bb, *succ, *split, *pos;
+    unsigned i;
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        if (bb->num_succs < 2)
+            continue;
+
+        for (i = 0, pos = bb; i < bb->num_succs; i++) {
+            succ = bb->succs[i];
+            if (succ->num_preds < 2 && succ->first->op != IR_PHI)
+                continue;
+            split = ir_split_edge(fn, bb, i);
+            ir_move_block_after(fn, split, pos);
+            pos = split;
+        }
+    }
+}
+
+//
+// Find the closest common dominator of two blocks whose dominators are known.
+//
+static struct ir_block *common_dominator(struct ir_block *a, struct ir_block *b)
+{
+    while (a != b) {
+        while (a->order > b->order)
+            a = a->idom;
+        while (b->order > a->order)
+            b = b->idom;
+    }
+    return a;
+}
+
+unsigned ir_compute_dominators(struct ir_function *fn, struct ir_block **order)
+{
+    struct ir_block **stack = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    unsigned *next = calloc(fn->num_blocks, sizeof(unsigned));
+    struct ir_block *bb, *succ, *idom, *tmp;
+    unsigned i, j, n = 0, depth = 0;
+    bool changed;
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        bb->idom = NULL;
+        bb->order = ~0u;
+    }
+
+    // depth-first search, listing each block after its successors
+    stack[depth++] = fn->entry;
+    fn->entry->order = 0;
+    while (depth) {
+        bb = stack[depth - 1];
+        if (next[bb->id] < bb->num_succs) {
+            succ = bb->succs[next[bb->id]++];
+            if (succ->order == ~0u) {
+                succ->order = 0;
+                stack[depth++] = succ;
+            }
+            continue;
+        }
+        order[n++] = bb;
+        depth--;
+    }
+
+    for (i = 0; i < n / 2; i++) {
+        tmp = order[i];
+        order[i] = order[n - 1 - i];
+        order[n - 1 - i] = tmp;
+    }
+    for (i = 0; i < n; i++)
+        order[i]->order = i;
+
+    // iterate to the fixed point; in reverse postorder a few rounds do
+    fn->entry->idom = fn->entry;
+    do {
+        changed = false;
+        for (i = 1; i < n; i++) {
+            bb = order[i];
+            idom = NULL;
+            for (j = 0; j < bb->num_preds; j++)
+                if (bb->preds[j]->idom)
+                    idom = idom ? common_dominator(bb->preds[j], idom) : bb->preds[j];
+            if (bb->idom != idom) {
+                bb->idom = idom;
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    free(stack);
+    free(next);
+    return n;
+}
+
+//
+// Print an operand.
+//
+static void dump_value(FILE *out, const struct ir_inst *value)
+{
+    if (value->op == IR_CONST)
+        fprintf(out, "%ld", (long) value->imm);
+    else
+        fprintf(out, "v%u", value->id);
+}
+
+static void dump_inst(FILE *out, const struct ir_inst *inst)
+{
+    const struct ir_block *bb = inst->block;
+    unsigned i;
+
+    fprintf(out, "  ");
+    if (!ir_has_side_effects(inst->op) || inst->op == IR_CALL)
+        fprintf(out, "v%u = ", inst->id);
+    fprintf(out, "%s", op_names[inst->op]);
+
+    switch (inst->op) {
+    case IR_CONST:
+    case IR_STRING:
+    case IR_PARAM:
+        fprintf(out, " %ld", (long) inst->imm);
+        break;
+    case IR_SLOT:
+        fprintf(out, " %ld", (long) inst->imm);
+        if (inst->vector)
+            fprintf(out, " [%ju]", inst->vector);
+        break;
+    case IR_GLOBAL:
+        fprintf(out, " %s", inst->name);
+        break;
+    case IR_PHI:
+        for (i = 0; i < inst->num_args; i++) {
+            fprintf(out, "%s[", i ? ", " : " ");
+            dump_value(out, inst->args[i].value);
+            fprintf(out, ", bb%u]", i < bb->num_preds ? bb->preds[i]->id : ~0u);
+        }
+        break;
+    case IR_SWITCH:
+        fprintf(out, " ");
+        dump_value(out, inst->args[0].value);
+        for (i = 1; i < bb->num_succs; i++)
+            fprintf(out, ", %ld: bb%u", (long) inst->cases[i], bb->succs[i]->id);
+        fprintf(out, ", default: bb%u", bb->succs[0]->id);
+        break;
+    default:
+        for (i = 0; i < inst->num_args; i++) {
+            fprintf(out, "%s", i ? ", " : " ");
+            dump_value(out, inst->args[i].value);
+        }
+        for (i = 0; i < bb->num_succs && ir_is_terminator(inst->op); i++)
+            fprintf(out, "%sbb%u", i || inst->num_args ? ", " : " ", bb->succs[i]->id);
+    }
+    fprintf(out, "\n");
+}
+
+void ir_dump(FILE *out, const struct ir_function *fn)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+    unsigned i;
+
+    flockfile(out);
+    fprintf(out, "function %s(%u), %ju slots\n", fn->name, fn->num_args, fn->num_slots);
+    for (bb = fn->entry; bb; bb = bb->next) {
+        fprintf(out, "bb%u:", bb->id);
+        for (i = 0; i < bb->num_preds; i++)
+            fprintf(out, "%s bb%u", i ? "," : " ; from", bb->preds[i]->id);
+        fprintf(out, "\n");
+        for (inst = bb->first; inst; inst = inst->next)
+            dump_inst(out, inst);
+    }
+    funlockfile(out);
+}
+
+//
+// Report a broken invariant.
+//
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "IR of %s after %s: ", fn->name, after); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            ok = false; \
+        } \
+    } while (0)
+
+void ir_verify(const struct ir_function *fn, const char *after)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+    const struct ir_use *use;
+    unsigned i, n;
+    bool ok = true;
+
+    CHECK(fn->entry && !fn->entry->num_preds, "entry block has predecessors");
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        CHECK(bb->last && ir_is_terminator(bb->last->op), "bb%u has no terminator", bb->id);
+        CHECK(!bb->next || bb->next->prev == bb, "broken layout after bb%u", bb->id);
+
+        for (i = 0; i < bb->num_succs; i++) {
+            CHECK(bb->succs[i] && ir_pred_index(bb->succs[i], bb) >= 0, "edge bb%u -> bb%u is one-way", bb->id, bb->succs[i] ? bb->succs[i]->id : ~0u);
+        }
+        for (i = 0; i < bb->num_preds; i++) {
+            const struct ir_block *pred = bb->preds[i];
+            unsigned j, edges = 0, back = 0;
+            for (j = 0; j < pred->num_succs; j++)
+                edges += pred->succs[j] == bb;
+            for (j = 0; j < bb->num_preds; j++)
+                back += bb->preds[j] == pred;
+            CHECK(edges == back, "edges bb%u -> bb%u do not match", pred->id, bb->id);
+        }
+
+        for (inst = bb->first; inst; inst = inst->next) {
+            CHECK(inst->block == bb, "v%u is in the wrong block", inst->id);
+            CHECK(!inst->next || inst->next->prev == inst, "broken list after v%u", inst->id);
+            CHECK(!ir_is_terminator(inst->op) || inst == bb->last, "terminator v%u in the middle of bb%u", inst->id, bb->id);
+            CHECK(inst->op != IR_PHI || !inst->prev || inst->prev->op == IR_PHI, "phi v%u after other instructions", inst->id);
+            CHECK(inst->op != IR_PHI || inst->num_args == bb->num_preds, "phi v%u has %u operands for %u predecessors", inst->id, inst->num_args, bb->num_preds);
+            CHECK(inst->op != IR_PARAM || (bb == fn->entry && (!inst->prev || inst->prev->op == IR_PARAM)), "param v%u not at the top of the entry block", inst->id);
+
+            for (i = 0; i < inst->num_args; i++) {
+                CHECK(inst->args[i].user == inst, "operand %u of v%u has the wrong user", i, inst->id);
+                CHECK(inst->args[i].value->block, "v%u uses deleted v%u", inst->id, inst->args[i].value->id);
+                for (use = inst->args[i].value->uses; use && use != &inst->args[i]; use = use->next);
+                CHECK(use, "operand %u of v%u is not among the uses of v%u", i, inst->id, inst->args[i].value->id);
+            }
+
+            for (n = 0, use = inst->uses; use; use = use->next, n++) {
+                CHECK(use->value == inst, "use of v%u is chained to v%u", use->user->id, inst->id);
+                CHECK(!use->next || use->next->prev == use, "broken use chain of v%u", inst->id);
+            }
+            CHECK(!n || !ir_has_side_effects(inst->op) || inst->op == IR_CALL, "v%u yields nothing but is used", inst->id);
+        }
+    }
+
+    if (!ok) {
+        ir_dump(stderr, fn);
+        abort();
+    }
+}
@@ -0,0 +1,268 @@
+#ifndef BCAUSE_IR_H
+#define BCAUSE_IR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+
+//
+// Intermediate representation of one function in SSA form.
+//
+// A function is a list of basic blocks, each one a list of instructions
+// ending with a terminator. Every instruction that yields something yields
+// a single machine word (`word_size` bytes); B has no other type. Stack
+// slots are memory: they are reached through the address IR_SLOT yields,
+// like globals through IR_GLOBAL, until a pass turns them into values.
+//
+enum ir_op {
+    /* values without operands */
+    IR_CONST,   /* the number `imm` */
+    IR_STRING,  /* address of string `imm` of the string table */
+    IR_GLOBAL,  /* address of the external `name` */
+    IR_SLOT,    /* address of stack slot `imm` */
+    IR_PARAM,   /* incoming argument number `imm`, at the top of the entry block */
+
+    /* arithmetic, in the order of enum binary_operator */
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD, IR_SHL, IR_SAR, IR_AND, IR_OR,
+    /* comparisons yielding 0 or 1, in the order of enum cmp_operator */
+    IR_LT, IR_LE, IR_GT, IR_GE, IR_EQ, IR_NE,
+    IR_NEG,     /* -args[0] */
+
+    IR_LOAD,    /* word at address args[0] */
+    IR_STORE,   /* store args[1] at address args[0], yields nothing */
+    IR_CALL,    /* call address args[0] with arguments args[1...]; slots from `imm` up are free meanwhile */
+    IR_PHI,     /* args[i] when entered from block->preds[i] */
+
+    /* terminators */
+    IR_JMP,     /* go to succs[0] */
+    IR_BR,      /* go to succs[0] if args[0] is nonzero, else to succs[1] */
+    IR_SWITCH,  /* go to succs[i] if args[0] equals cases[i] (i > 0), else to succs[0] */
+    IR_RET,     /* return args[0] */
+};
+
+struct ir_inst;
+struct ir_block;
+
+//
+// Operand of an instruction.
+// All uses of a value are chained, so that it can be replaced everywhere.
+//
+struct ir_use {
+    struct ir_inst *value; /* the operand */
+    struct ir_inst *user; /* the instruction using it */
+    struct ir_use *prev, *next; /* other uses of `value` */
+};
+
+struct ir_inst {
+    enum ir_op op;
+    unsigned id; /* unique number within the function */
+    struct ir_block *block; /* block the instruction is in */
+    struct ir_inst *prev, *next; /* neighbours in the block */
+
+    intptr_t imm; /* constant, string index, stack slot, argument number or first free slot */
+    uintmax_t vector; /* IR_SLOT: length of the vector in the slot and the ones below it, or 0 */
+    const char *name; /* IR_GLOBAL: interned symbol name */
+    intptr_t *cases; /* IR_SWITCH: case value of each successor */
+
+    struct ir_use *args; /* operands */
+    unsigned num_args, max_args;
+    struct ir_use *uses; /* first use of this value */
+};
+
+struct ir_block {
+    unsigned id; /* unique number within the function */
+    struct ir_block *prev, *next; /* neighbours in the layout of the function */
+    struct ir_inst *first, *last; /* instructions, `last` is the terminator */
+
+    struct ir_block **preds; /* one entry per incoming edge */
+    unsigned num_preds, max_preds;
+    struct ir_block **succs; /* one entry per outgoing edge */
+    unsigned num_succs;
+
+    struct ir_block *idom; /* immediate dominator, see ir_compute_dominators() */
+    unsigned order; /* position in reverse postorder */
+};
+
+struct ir_function {
+    const char *name; /* interned function name */
+    unsigned num_args; /* number of arguments */
+    unsigned char word_size; /* size of every value */
+    uintmax_t num_slots; /* words of stack slots addressed by IR_SLOT */
+
+    struct ir_block *entry, *exit; /* first and last block of the layout */
+    unsigned num_blocks; /* block ids are below this */
+    unsigned num_insts; /* instruction ids are below this */
+
+    struct arena *arena; /* storage for everything above */
+};
+
+static inline bool ir_is_binary(enum ir_op op)
+{
+    return op >= IR_ADD && op <= IR_NE;
+}
+
+static inline bool ir_is_cmp(enum ir_op op)
+{
+    return op >= IR_LT && op <= IR_NE;
+}
+
+static inline bool ir_is_terminator(enum ir_op op)
+{
+    return op >= IR_JMP;
+}
+
+//
+// Tell whether an instruction does more than yielding its value,
+// i.e. whether it must stay even when its value is not used.
+//
+static inline bool ir_has_side_effects(enum ir_op op)
+{
+    return op == IR_STORE || op == IR_CALL || ir_is_terminator(op);
+}
+
+static inline bool ir_has_uses(const struct ir_inst *inst)
+{
+    return inst->uses != NULL;
+}
+
+//
+// Iterate over the phi nodes at the top of a block.
+//
+#define ir_foreach_phi(phi, bb) \
+    for ((phi) = (bb)->first; (phi) && (phi)->op == IR_PHI; (phi) = (phi)->next)
+
+struct ir_function *ir_new_function(struct arena *arena, const char *name, unsigned num_args, unsigned char word_size);
+
+//
+// Add an empty block at the end of the layout.
+//
+struct ir_block *ir_new_block(struct ir_function *fn);
+
+//
+// Create an instruction without operands that is not in any block yet.
+//
+struct ir_inst *ir_new_inst(struct ir_function *fn, enum ir_op op);
+
+//
+// Create an instruction at the end of `bb`, before its terminator if it has one.
+// Phi nodes are put after the other phi nodes at the top instead.
+//
+struct ir_inst *ir_emit(struct ir_function *fn, struct ir_block *bb, enum ir_op op);
+
+//
+// Shorthands for ir_emit().
+//
+struct ir_inst *ir_emit_imm(struct ir_function *fn, struct ir_block *bb, enum ir_op op, intptr_t imm);
+struct ir_inst *ir_emit_unary(struct ir_function *fn, struct ir_block *bb, enum ir_op op, struct ir_inst *a);
+struct ir_inst *ir_emit_binary(struct ir_function *fn, struct ir_block *bb, enum ir_op op, struct ir_inst *a, struct ir_inst *b);
+
+//
+// Terminate a block, adding it to the predecessors of its successors.
+//
+void ir_jmp(struct ir_function *fn, struct ir_block *bb, struct ir_block *target);
+void ir_br(struct ir_function *fn, struct ir_block *bb, struct ir_inst *cond, struct ir_block *then, struct ir_block *other);
+void ir_ret(struct ir_function *fn, struct ir_block *bb, struct ir_inst *value);
+struct ir_inst *ir_switch(struct ir_function *fn, struct ir_block *bb, struct ir_inst *value, unsigned num_cases);
+
+//
+// Set case `i` of a switch terminating `bb`, or its default for `i` == -1.
+//
+void ir_set_case(struct ir_function *fn, struct ir_block *bb, unsigned i, intptr_t value, struct ir_block *target);
+
+//
+// Insert an instruction that is in no block before `pos`, or at the end of `bb`.
+//
+void ir_insert_before(struct ir_inst *pos, struct ir_inst *inst);
+void ir_append(struct ir_block *bb, struct ir_inst *inst);
+
+//
+// Take an instruction out of its block, keeping its operands.
+//
+void ir_unlink(struct ir_inst *inst);
+
+//
+// Delete an instruction whose value is not used any more.
+//
+void ir_remove(struct ir_inst *inst);
+
+void ir_add_arg(struct ir_function *fn, struct ir_inst *inst, struct ir_inst *value);
+void ir_set_arg(struct ir_inst *inst, unsigned i, struct ir_inst *value);
+void ir_remove_arg(struct ir_inst *inst, unsigned i);
+
+//
+// Make all users of `old` use `value` instead.
+//
+void ir_replace_uses(struct ir_inst *old, struct ir_inst *value);
+
+//
+// Replace the terminator of `bb` with a jump along its outgoing edge `i`,
+// dropping the other edges.
+//
+void ir_make_jmp(struct ir_function *fn, struct ir_block *bb, unsigned i);
+
+//
+// Drop incoming edge `i` of a block, with the matching phi operands.
+//
+void ir_remove_pred(struct ir_block *bb, unsigned i);
+
+//
+// Return the index of `pred` among the predecessors of `bb`, or -1.
+//
+int ir_pred_index(const struct ir_block *bb, const struct ir_block *pred);
+
+//
+// Turn outgoing edge `i` of `bb` towards `target`.
+// Phi nodes of `target` receive `value`'s for the new edge; `values`
+// lists them in phi order and may be NULL if `target` has no phi nodes.
+//
+void ir_retarget(struct ir_function *fn, struct ir_block *bb, unsigned i, struct ir_block *target, struct ir_inst **values);
+
+//
+// Take a block out of the layout and drop its edges and the operands of
+// its instructions. Its values must not be used elsewhere, and the blocks
+// leading to it must be removed as well.
+//
+void ir_remove_block(struct ir_function *fn, struct ir_block *bb);
+
+//
+// Move `bb` right after `pos` in the layout.
+//
+void ir_move_block_after(struct ir_function *fn, struct ir_block *bb, struct ir_block *pos);
+
+//
+// Put a new block, which jumps on, on outgoing edge `i` of `bb`, taking
+// over the place of `bb` among the predecessors of the successor, and
+// return it. It comes last in the layout.
+//
+struct ir_block *ir_split_edge(struct ir_function *fn, struct ir_block *bb, unsigned i);
+
+//
+// Put a block on every edge that leaves a block with several successors
+// for a block with several predecessors or phi nodes, so that code for
+// such an edge, like the copies of phi operands, has a place of its own.
+// The new blocks follow the block, in the order of its successors.
+//
+void ir_split_critical_edges(struct ir_function *fn);
+
+//
+// List the blocks reachable from the entry block in reverse postorder in
+// `order`, which has room for `num_blocks` blocks, and find their immediate
+// dominators; the entry block is its own. Return the number of blocks listed.
+//
+unsigned ir_compute_dominators(struct ir_function *fn, struct ir_block **order);
+
+//
+// Print a function in human readable form.
+//
+void ir_dump(FILE *out, const struct ir_function *fn);
+
+//
+// Check the structural invariants of a function.
+// Print the problems and abort if there are any.
+//
+void ir_verify(const struct ir_function *fn, const char *after);
+
+#endif /* BCAUSE_IR_H */
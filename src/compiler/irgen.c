@@ -0,0 +1,350 @@
+#include "irgen.h"
+#include "codegen.h"
+#include "list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct irgen {
+    struct ir_function *fn;
+    struct ir_block *bb; /* block the code goes into, never terminated */
+    struct ir_block **labels; /* block of each named label */
+    uintmax_t stack_offset; /* words of locals allocated at this point */
+
+    struct list *case_values; /* case values of the innermost switch */
+    struct list *case_blocks; /* and the blocks they start */
+};
+
+static struct ir_inst *expr(struct irgen *g, const struct node *node, bool *lvalue);
+
+//
+// Continue in block `bb`. Blocks are laid out in the order they are filled,
+// which is the order of the source code.
+//
+static void start_block(struct irgen *g, struct ir_block *bb)
+{
+    ir_move_block_after(g->fn, bb, g->fn->exit);
+    g->bb = bb;
+}
+
+//
+// Jump to `target` and continue there.
+//
+static void enter_block(struct irgen *g, struct ir_block *target)
+{
+    ir_jmp(g->fn, g->bb, target);
+    start_block(g, target);
+}
+
+//
+// Continue after a jump in a block nothing leads to (yet).
+//
+static void start_unreachable(struct irgen *g)
+{
+    start_block(g, ir_new_block(g->fn));
+}
+
+static struct ir_inst *constant(struct irgen *g, intptr_t value)
+{
+    return ir_emit_imm(g->fn, g->bb, IR_CONST, value);
+}
+
+//
+// Evaluate an expression, loading the value if it is an lvalue.
+//
+static struct ir_inst *rvalue(struct irgen *g, const struct node *node)
+{
+    bool lvalue;
+    struct ir_inst *value = expr(g, node, &lvalue);
+
+    return lvalue ? ir_emit_unary(g->fn, g->bb, IR_LOAD, value) : value;
+}
+
+//
+// Evaluate an expression.
+// Set `*lvalue` when the result is the address of the value, exactly where
+// the stack machine leaves an address in %rax.
+//
+static struct ir_inst *expr(struct irgen *g, const struct node *node, bool *lvalue)
+{
+    struct ir_function *fn = g->fn;
+    struct ir_inst *addr, *value, *old, *call, *args[MAX_FN_CALL_ARGS];
+    struct ir_block *then, *other, *end;
+    const struct node *arg;
+    size_t i, n;
+    bool ignored;
+
+    *lvalue = false;
+
+    switch (node->kind) {
+    case NODE_NUMBER:
+        return constant(g, node->value);
+
+    case NODE_STRING:
+        return ir_emit_imm(fn, g->bb, IR_STRING, node->value);
+
+    case NODE_LOCAL:
+        *lvalue = true;
+        return ir_emit_imm(fn, g->bb, IR_SLOT, node->value);
+
+    case NODE_EXTRN:
+        *lvalue = true;
+        value = ir_emit(fn, g->bb, IR_GLOBAL);
+        value->name = node->name;
+        return value;
+
+    case NODE_INDEX:
+        // the vector is loaded from whatever the left side yields
+        addr = ir_emit_unary(fn, g->bb, IR_LOAD, expr(g, node->lhs, &ignored));
+        value = ir_emit_binary(fn, g->bb, IR_SHL, rvalue(g, node->rhs), constant(g, 3));
+        *lvalue = true;
+        return ir_emit_binary(fn, g->bb, IR_ADD, addr, value);
+
+    case NODE_CALL:
+        value = expr(g, node->lhs, &ignored);
+        for (arg = node->rhs, n = 0; arg; arg = arg->next)
+            args[n++] = rvalue(g, arg);
+
+        call = ir_emit_unary(fn, g->bb, IR_CALL, value);
+        call->imm = g->stack_offset; /* the slots of the variables in scope */
+        for (i = 0; i < n; i++)
+            ir_add_arg(fn, call, args[i]);
+        return call;
+
+    case NODE_POST_INC:
+    case NODE_POST_DEC:
+        addr = expr(g, node->lhs, &ignored);
+        old = ir_emit_unary(fn, g->bb, IR_LOAD, addr);
+        value = ir_emit_binary(fn, g->bb, node->kind == NODE_POST_INC ? IR_ADD : IR_SUB, old, constant(g, 1));
+        ir_emit_binary(fn, g->bb, IR_STORE, addr, value);
+        return old;
+
+    case NODE_PRE_INC:
+    case NODE_PRE_DEC:
+        addr = expr(g, node->lhs, &ignored);
+        old = ir_emit_unary(fn, g->bb, IR_LOAD, addr);
+        value = ir_emit_binary(fn, g->bb, node->kind == NODE_PRE_INC ? IR_ADD : IR_SUB, old, constant(g, 1));
+        ir_emit_binary(fn, g->bb, IR_STORE, addr, value);
+        *lvalue = true;
+        return addr;
+
+    case NODE_NEG:
+        return ir_emit_unary(fn, g->bb, IR_NEG, rvalue(g, node->lhs));
+
+    case NODE_NOT:
+        value = rvalue(g, node->lhs);
+        return ir_emit_binary(fn, g->bb, IR_EQ, value, constant(g, 0));
+
+    case NODE_DEREF:
+        *lvalue = true;
+        return rvalue(g, node->lhs);
+
+    case NODE_ADDR:
+        return expr(g, node->lhs, &ignored);
+
+    case NODE_BINARY:
+    case NODE_CMP:
+        value = rvalue(g, node->lhs);
+        return ir_emit_binary(fn, g->bb, (node->kind == NODE_BINARY ? IR_ADD : IR_LT) + node->op, value, rvalue(g, node->rhs));
+
+    case NODE_COND:
+        then = ir_new_block(fn);
+        other = ir_new_block(fn);
+        end = ir_new_block(fn);
+
+        ir_br(fn, g->bb, rvalue(g, node->cond), then, other);
+        start_block(g, then);
+        value = rvalue(g, node->lhs);
+        ir_jmp(fn, g->bb, end);
+        start_block(g, other);
+        old = rvalue(g, node->rhs);
+        enter_block(g, end);
+
+        // the value of each branch, in the order the jumps to `end` were made
+        return ir_emit_binary(fn, end, IR_PHI, value, old);
+
+    case NODE_ASSIGN:
+    case NODE_ASSIGN_BINARY:
+    case NODE_ASSIGN_CMP:
+        addr = expr(g, node->lhs, &ignored);
+
+        // the old value is read before the right side is evaluated
+        old = node->kind != NODE_ASSIGN ? ir_emit_unary(fn, g->bb, IR_LOAD, addr) : NULL;
+        value = rvalue(g, node->rhs);
+        if (node->kind != NODE_ASSIGN)
+            value = ir_emit_binary(fn, g->bb, (node->kind == NODE_ASSIGN_BINARY ? IR_ADD : IR_LT) + node->op, old, value);
+
+        ir_emit_binary(fn, g->bb, IR_STORE, addr, value);
+        return value;
+
+    default:
+        fprintf(stderr, "irgen: unexpected node kind %d in expression\n", node->kind);
+        exit(1);
+    }
+}
+
+//
+// Translate a statement.
+//
+static void statement(struct irgen *g, const struct node *node)
+{
+    struct ir_function *fn = g->fn;
+    struct ir_block *body, *other, *end, *dispatch;
+    struct list values, blocks, *outer_values, *outer_blocks;
+    const struct node *stmt, *var;
+    struct ir_inst *value;
+    uintmax_t stack_offset;
+    size_t i, j, num_cases;
+
+    switch (node->kind) {
+    case NODE_NULL:
+        break;
+
+    case NODE_BLOCK:
+        stack_offset = g->stack_offset;
+        for (stmt = node->lhs; stmt; stmt = stmt->next)
+            statement(g, stmt);
+        g->stack_offset = stack_offset;
+        break;
+
+    case NODE_AUTO:
+        for (var = node->lhs; var; var = var->next) {
+            if (var->value < 0) {
+                g->stack_offset += 1;
+                continue;
+            }
+
+            // the last slot points to the vector in the ones below it
+            g->stack_offset += var->value + 1;
+            value = ir_emit_imm(fn, g->bb, IR_SLOT, (intptr_t) g->stack_offset - 2);
+            value->vector = var->value;
+            ir_emit_binary(fn, g->bb, IR_STORE, ir_emit_imm(fn, g->bb, IR_SLOT, g->stack_offset - 1), value);
+        }
+
+        if (g->stack_offset % 2)
+            g->stack_offset++;
+        if (g->stack_offset > fn->num_slots)
+            fn->num_slots = g->stack_offset;
+        break;
+
+    case NODE_LABEL:
+        enter_block(g, g->labels[node->value]);
+        statement(g, node->lhs);
+        break;
+
+    case NODE_GOTO:
+        ir_jmp(fn, g->bb, g->labels[node->value]);
+        start_unreachable(g);
+        break;
+
+    case NODE_RETURN:
+        ir_ret(fn, g->bb, node->lhs ? rvalue(g, node->lhs) : constant(g, 0));
+        start_unreachable(g);
+        break;
+
+    case NODE_IF:
+        body = ir_new_block(fn);
+        other = node->rhs ? ir_new_block(fn) : NULL;
+        end = ir_new_block(fn);
+
+        ir_br(fn, g->bb, rvalue(g, node->cond), body, other ? other : end);
+        start_block(g, body);
+        statement(g, node->lhs);
+        if (other) {
+            ir_jmp(fn, g->bb, end);
+            start_block(g, other);
+            statement(g, node->rhs);
+        }
+        enter_block(g, end);
+        break;
+
+    case NODE_WHILE:
+        other = ir_new_block(fn);
+        body = ir_new_block(fn);
+        end = ir_new_block(fn);
+
+        enter_block(g, other);
+        ir_br(fn, g->bb, rvalue(g, node->cond), body, end);
+        start_block(g, body);
+        statement(g, node->lhs);
+        ir_jmp(fn, g->bb, other);
+        start_block(g, end);
+        break;
+
+    case NODE_SWITCH:
+        value = rvalue(g, node->cond);
+        dispatch = g->bb;
+        end = ir_new_block(fn);
+
+        // statements before the first case are never reached
+        outer_values = g->case_values;
+        outer_blocks = g->case_blocks;
+        memset(&values, 0, sizeof(struct list));
+        memset(&blocks, 0, sizeof(struct list));
+        g->case_values = &values;
+        g->case_blocks = &blocks;
+
+        start_unreachable(g);
+        statement(g, node->lhs);
+        enter_block(g, end);
+
+        g->case_values = outer_values;
+        g->case_blocks = outer_blocks;
+
+        // the first of several equal cases wins, like in a chain of compares
+        for (i = num_cases = 0; i < values.size; i++) {
+            for (j = 0; j < i && values.data[j] != values.data[i]; j++);
+            if (j == i) {
+                values.data[num_cases] = values.data[i];
+                blocks.data[num_cases++] = blocks.data[i];
+            }
+        }
+
+        ir_switch(fn, dispatch, value, num_cases);
+        ir_set_case(fn, dispatch, -1, 0, end);
+        for (i = 0; i < num_cases; i++)
+            ir_set_case(fn, dispatch, i, (intptr_t) values.data[i], (struct ir_block*) blocks.data[i]);
+
+        list_free(&values);
+        list_free(&blocks);
+        break;
+
+    case NODE_CASE:
+        body = ir_new_block(fn);
+        list_push(g->case_values, (void*) node->value);
+        list_push(g->case_blocks, body);
+        enter_block(g, body);
+        statement(g, node->lhs);
+        break;
+
+    default:
+        rvalue(g, node);
+    }
+}
+
+struct ir_function *ir_build(struct arena *arena, const struct function *fn, unsigned char word_size)
+{
+    struct irgen g;
+    struct ir_inst *params[MAX_FN_CALL_ARGS];
+    size_t i;
+
+    memset(&g, 0, sizeof(struct irgen));
+    g.fn = ir_new_function(arena, fn->name, fn->num_args, word_size);
+    g.bb = ir_new_block(g.fn);
+
+    g.labels = arena_alloc(arena, fn->num_named_labels * sizeof(struct ir_block*));
+    for (i = 0; i < fn->num_named_labels; i++)
+        g.labels[i] = ir_new_block(g.fn);
+
+    // arguments get the first slots
+    for (i = 0; i < fn->num_args; i++)
+        params[i] = ir_emit_imm(g.fn, g.bb, IR_PARAM, i);
+    for (i = 0; i < fn->num_args; i++)
+        ir_emit_binary(g.fn, g.bb, IR_STORE, ir_emit_imm(g.fn, g.bb, IR_SLOT, i), params[i]);
+    g.stack_offset = g.fn->num_slots = fn->num_args;
+
+    statement(&g, fn->body);
+    ir_ret(g.fn, g.bb, constant(&g, 0));
+    return g.fn;
+}
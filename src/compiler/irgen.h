@@ -0,0 +1,15 @@
+#ifndef BCAUSE_IRGEN_H
+#define BCAUSE_IRGEN_H
+
+#include "arena.h"
+#include "ast.h"
+#include "ir.h"
+
+//
+// Translate a function definition into intermediate code allocated in `arena`.
+// Arguments and autos get the stack slots the stack machine gives them, and
+// are read and written through IR_LOAD and IR_STORE.
+//
+struct ir_function *ir_build(struct arena *arena, const struct function *fn, unsigned char word_size);
+
+#endif /* BCAUSE_IRGEN_H */
@@ -0,0 +1,456 @@
+#include "lexer.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+//
+// Keywords, placed by a perfect hash of their first two characters and
+// their length (see KEYWORD_HASH). Every keyword hashes to its own slot,
+// so classifying an identifier takes a single comparison.
+//
+#define KEYWORD_HASH(str, len) (((unsigned char) (str)[0] + 8 * (unsigned char) (str)[1] + (len)) & 15)
+#define KEYWORD_MIN_LEN 2
+#define KEYWORD_MAX_LEN 6
+
+static const struct keyword {
+    const char *name;
+    size_t len;
+    enum token_kind kind;
+} keywords[16] = {
+    [0]  = { "return", 6, TOK_RETURN },
+    [1]  = { "switch", 6, TOK_SWITCH },
+    [3]  = { "goto",   4, TOK_GOTO },
+    [9]  = { "else",   4, TOK_ELSE },
+    [10] = { "extrn",  5, TOK_EXTRN },
+    [11] = { "if",     2, TOK_IF },
+    [12] = { "while",  5, TOK_WHILE },
+    [13] = { "auto",   4, TOK_AUTO },
+    [15] = { "case",   4, TOK_CASE },
+};
+
+static inline int lookahead(const struct lexer *lex, size_t n)
+{
+    return (size_t) (lex->end - lex->cur) > n ? (unsigned char) lex->cur[n] : EOF;
+}
+
+static inline int peek(const struct lexer *lex)
+{
+    return lex->cur < lex->end ? (unsigned char) *lex->cur : EOF;
+}
+
+static inline int next(struct lexer *lex)
+{
+    return lex->cur < lex->end ? (unsigned char) *lex->cur++ : EOF;
+}
+
+static inline bool accept(struct lexer *lex, int c)
+{
+    if (peek(lex) != c)
+        return false;
+    lex->cur++;
+    return true;
+}
+
+//
+// Move the reported position to `p`.
+//
+static inline void set_pos(struct lexer *lex, const char *p)
+{
+    lex->ctx->pos.offset = p - lex->start;
+}
+
+void lexer_init(struct lexer *lex, struct compiler_ctx *ctx, unsigned char word_size, const char *data, size_t size)
+{
+    memset(lex, 0, sizeof(struct lexer));
+    lex->ctx = ctx;
+    lex->word_size = word_size;
+    lex->start = data;
+    lex->cur = lex->tok.text = data + ctx->pos.offset;
+    lex->end = data + size;
+    lexer_next(lex);
+}
+
+void lexer_free(struct lexer *lex)
+{
+    intern_free(&lex->idents);
+    free(lex->buf);
+}
+
+//
+// Parse a comment.
+// It starts with /* and finishes with */.
+//
+static void comment(struct lexer *lex)
+{
+    const char *start = lex->cur - 2;
+
+    while ((lex->cur = scan_comment(lex->cur, lex->end)) < lex->end) {
+        lex->cur++;
+        if (accept(lex, '/'))
+            return;
+    }
+
+    set_pos(lex, start);
+    compile_error(lex->ctx, "unclosed comment, expect " QUOTE_FMT("*/") " to close the comment\n");
+}
+
+//
+// Skip whitespace characters and comments.
+//
+static void whitespace(struct lexer *lex)
+{
+    for (;;) {
+        lex->cur = scan_space(lex->cur, lex->end);
+
+        if (peek(lex) == '/' && lookahead(lex, 1) == '*') {
+            lex->cur += 2;
+            comment(lex);
+            continue;
+        }
+        return;
+    }
+}
+
+//
+// Decode the character following an escape character `*`.
+//
+static int escape(struct lexer *lex)
+{
+    int c;
+
+    switch (c = next(lex)) {
+    case '0':
+    case 'e':
+        return '\0';
+    case '(':
+    case ')':
+    case '*':
+    case '\'':
+    case '"':
+        return c;
+    case 't':
+        return '\t';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    default:
+        set_pos(lex, lex->cur - 2);
+        compile_error(lex->ctx, "undefined escape character " QUOTE_FMT("*%c") "\n", c);
+    }
+}
+
+//
+// Scan an identifier or keyword.
+// It may include alphanumeric characters or underscore.
+//
+static void identifier(struct lexer *lex, struct token *tok)
+{
+    const struct keyword *kw;
+    size_t len;
+    int c;
+
+    while ((c = peek(lex)) != EOF && (isalnum(c) || c == '_'))
+        lex->cur++;
+
+    len = lex->cur - tok->text;
+    if (len >= KEYWORD_MIN_LEN && len <= KEYWORD_MAX_LEN) {
+        kw = &keywords[KEYWORD_HASH(tok->text, len)];
+        if (kw->len == len && memcmp(kw->name, tok->text, len) == 0) {
+            tok->kind = kw->kind;
+            return;
+        }
+    }
+
+    tok->kind = TOK_IDENT;
+    tok->name = intern(&lex->idents, tok->text, len);
+}
+
+//
+// Scan an integer literal.
+// Leading zero means octal value.
+//
+static void number(struct lexer *lex, struct token *tok)
+{
+    intptr_t num = 0;
+    int c, base = peek(lex) == '0' ? 8 : 10;
+
+    while (isdigit(c = peek(lex))) {
+        num = (num * base) + c - '0';
+        lex->cur++;
+    }
+
+    tok->kind = TOK_NUMBER;
+    tok->value = num;
+}
+
+//
+// Scan a multi-character literal.
+//
+static void character(struct lexer *lex, struct token *tok)
+{
+    intptr_t value = 0;
+    int c, i;
+
+    for (i = 0; i < lex->word_size; i++) {
+        if ((c = next(lex)) == '\'')
+            goto done;
+
+        if (c == '*')
+            c = escape(lex);
+        else if (c == EOF)
+            break;
+
+        // Little endian.
+        value |= ((uintptr_t) (uint8_t) c) << (i * 8);
+    }
+
+    if (next(lex) != '\'') {
+        set_pos(lex, tok->text);
+        compile_error(lex->ctx, "unclosed char literal\n");
+    }
+
+done:
+    tok->kind = TOK_CHAR;
+    tok->value = value;
+}
+
+//
+// Scan a string literal.
+// Runs of plain characters between escapes are copied in bulk into the
+// lexer's buffer, and the decoded string is interned in the string table.
+//
+static void string(struct lexer *lex, struct token *tok)
+{
+    int c;
+    size_t size = 0, run;
+    const char *start;
+
+    for (;;) {
+        start = lex->cur;
+        lex->cur = scan_string(lex->cur, lex->end);
+        run = lex->cur - start;
+
+        // room for the run, one escaped character and the terminator
+        if (size + run + 2 > lex->buf_size) {
+            if (!lex->buf_size)
+                lex->buf_size = 32;
+            while (size + run + 2 > lex->buf_size)
+                lex->buf_size *= 2;
+            lex->buf = (char*) realloc(lex->buf, lex->buf_size);
+        }
+        memcpy(lex->buf + size, start, run);
+        size += run;
+
+        if ((c = next(lex)) == '"')
+            break;
+        if (c == EOF) {
+            set_pos(lex, tok->text);
+            compile_error(lex->ctx, "unterminated string literal\n");
+        }
+        lex->buf[size++] = escape(lex);
+    }
+    lex->buf[size] = 0;
+
+    // the string ends at its first null character
+    tok->kind = TOK_STRING;
+    tok->value = intern_add(&lex->ctx->strings, lex->buf, strlen(lex->buf))->index;
+}
+
+//
+// Scan the characters following `=`.
+// B spells compound assignments with the operator after the `=`.
+//
+static enum token_kind assignment(struct lexer *lex)
+{
+    switch (peek(lex)) {
+    case '+':
+        lex->cur++;
+        return TOK_ASSIGN_ADD;
+    case '-':
+        lex->cur++;
+        return TOK_ASSIGN_SUB;
+    case '*':
+        lex->cur++;
+        return TOK_ASSIGN_MUL;
+    case '/':
+        lex->cur++;
+        return TOK_ASSIGN_DIV;
+    case '%':
+        lex->cur++;
+        return TOK_ASSIGN_MOD;
+    case '&':
+        lex->cur++;
+        return TOK_ASSIGN_AND;
+    case '|':
+        lex->cur++;
+        return TOK_ASSIGN_OR;
+    case '<':
+        lex->cur++;
+        if (accept(lex, '<'))
+            return TOK_ASSIGN_SHL;
+        if (accept(lex, '='))
+            return TOK_ASSIGN_LE;
+        return TOK_ASSIGN_LT;
+    case '>':
+        lex->cur++;
+        if (accept(lex, '>'))
+            return TOK_ASSIGN_SHR;
+        if (accept(lex, '='))
+            return TOK_ASSIGN_GE;
+        return TOK_ASSIGN_GT;
+    case '!':
+        if (lookahead(lex, 1) != '=')
+            return TOK_ASSIGN;
+        lex->cur += 2;
+        return TOK_ASSIGN_NE;
+    case '=':
+        lex->cur++;
+        if (accept(lex, '='))
+            return TOK_ASSIGN_EQ;
+        return TOK_EQ;
+    default:
+        return TOK_ASSIGN;
+    }
+}
+
+//
+// Scan one token starting at the current position.
+//
+static void scan(struct lexer *lex, struct token *tok)
+{
+    int c;
+
+    whitespace(lex);
+    tok->text = lex->cur;
+
+    c = peek(lex);
+    if (isalpha(c) || c == '_')
+        identifier(lex, tok);
+    else if (isdigit(c))
+        number(lex, tok);
+    else {
+        lex->cur++;
+        switch (c) {
+        case EOF:
+            lex->cur = lex->end;
+            tok->kind = TOK_EOF;
+            break;
+        case '\'':
+            character(lex, tok);
+            break;
+        case '"':
+            string(lex, tok);
+            break;
+        case '(':
+            tok->kind = TOK_LPAREN;
+            break;
+        case ')':
+            tok->kind = TOK_RPAREN;
+            break;
+        case '[':
+            tok->kind = TOK_LBRACKET;
+            break;
+        case ']':
+            tok->kind = TOK_RBRACKET;
+            break;
+        case '{':
+            tok->kind = TOK_LBRACE;
+            break;
+        case '}':
+            tok->kind = TOK_RBRACE;
+            break;
+        case ',':
+            tok->kind = TOK_COMMA;
+            break;
+        case ';':
+            tok->kind = TOK_SEMICOLON;
+            break;
+        case ':':
+            tok->kind = TOK_COLON;
+            break;
+        case '?':
+            tok->kind = TOK_QUESTION;
+            break;
+        case '+':
+            tok->kind = accept(lex, '+') ? TOK_INC : TOK_PLUS;
+            break;
+        case '-':
+            tok->kind = accept(lex, '-') ? TOK_DEC : TOK_MINUS;
+            break;
+        case '*':
+            tok->kind = TOK_STAR;
+            break;
+        case '/':
+            tok->kind = TOK_SLASH;
+            break;
+        case '%':
+            tok->kind = TOK_PERCENT;
+            break;
+        case '&':
+            tok->kind = TOK_AMP;
+            break;
+        case '|':
+            tok->kind = TOK_PIPE;
+            break;
+        case '!':
+            tok->kind = accept(lex, '=') ? TOK_NE : TOK_NOT;
+            break;
+        case '<':
+            tok->kind = accept(lex, '<') ? TOK_SHL : accept(lex, '=') ? TOK_LE : TOK_LT;
+            break;
+        case '>':
+            tok->kind = accept(lex, '>') ? TOK_SHR : accept(lex, '=') ? TOK_GE : TOK_GT;
+            break;
+        case '=':
+            tok->kind = assignment(lex);
+            break;
+        default:
+            set_pos(lex, tok->text);
+            compile_error(lex->ctx, "unexpected character " QUOTE_FMT("%c") "\n", c);
+        }
+    }
+
+    tok->length = lex->cur - tok->text;
+}
+
+//
+// Advance to the next token.
+//
+void lexer_next(struct lexer *lex)
+{
+    lex->prev_end = lex->tok.text + lex->tok.length;
+
+    if (lex->has_ahead) {
+        lex->tok = lex->ahead;
+        lex->has_ahead = false;
+    }
+    else
+        scan(lex, &lex->tok);
+
+    set_pos(lex, lex->tok.text);
+}
+
+//
+// Return the token after the current one without consuming anything.
+//
+const struct token *lexer_peek(struct lexer *lex)
+{
+    if (!lex->has_ahead) {
+        scan(lex, &lex->ahead);
+        lex->has_ahead = true;
+    }
+    return &lex->ahead;
+}
+
+//
+// Point the position right behind the previous token, where a token that
+// turned out to be missing (like a `;`) was expected.
+//
+void lexer_pos_missing(struct lexer *lex)
+{
+    set_pos(lex, lex->prev_end);
+}
@@ -0,0 +1,132 @@
+#ifndef BCAUSE_LEXER_H
+#define BCAUSE_LEXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "intern.h"
+
+enum token_kind {
+    TOK_EOF = 0,
+
+    TOK_IDENT,  /* identifier */
+    TOK_NUMBER, /* integer literal */
+    TOK_CHAR,   /* multi-character literal */
+    TOK_STRING, /* string literal */
+
+    /* keywords */
+    TOK_AUTO,
+    TOK_CASE,
+    TOK_ELSE,
+    TOK_EXTRN,
+    TOK_GOTO,
+    TOK_IF,
+    TOK_RETURN,
+    TOK_SWITCH,
+    TOK_WHILE,
+
+    /* punctuation */
+    TOK_LPAREN,    /* ( */
+    TOK_RPAREN,    /* ) */
+    TOK_LBRACKET,  /* [ */
+    TOK_RBRACKET,  /* ] */
+    TOK_LBRACE,    /* { */
+    TOK_RBRACE,    /* } */
+    TOK_COMMA,     /* , */
+    TOK_SEMICOLON, /* ; */
+    TOK_COLON,     /* : */
+    TOK_QUESTION,  /* ? */
+
+    /* operators */
+    TOK_PLUS,    /* + */
+    TOK_MINUS,   /* - */
+    TOK_STAR,    /* * */
+    TOK_SLASH,   /* / */
+    TOK_PERCENT, /* % */
+    TOK_AMP,     /* & */
+    TOK_PIPE,    /* | */
+    TOK_NOT,     /* ! */
+    TOK_INC,     /* ++ */
+    TOK_DEC,     /* -- */
+    TOK_SHL,     /* << */
+    TOK_SHR,     /* >> */
+    TOK_LT,      /* < */
+    TOK_LE,      /* <= */
+    TOK_GT,      /* > */
+    TOK_GE,      /* >= */
+    TOK_EQ,      /* == */
+    TOK_NE,      /* != */
+
+    /* assignment operators */
+    TOK_ASSIGN,     /* = */
+    TOK_ASSIGN_ADD, /* =+ */
+    TOK_ASSIGN_SUB, /* =- */
+    TOK_ASSIGN_MUL, /* =* */
+    TOK_ASSIGN_DIV, /* =/ */
+    TOK_ASSIGN_MOD, /* =% */
+    TOK_ASSIGN_AND, /* =& */
+    TOK_ASSIGN_OR,  /* =| */
+    TOK_ASSIGN_SHL, /* =<< */
+    TOK_ASSIGN_SHR, /* =>> */
+    TOK_ASSIGN_LT,  /* =< */
+    TOK_ASSIGN_LE,  /* =<= */
+    TOK_ASSIGN_GT,  /* => */
+    TOK_ASSIGN_GE,  /* =>= */
+    TOK_ASSIGN_EQ,  /* === */
+    TOK_ASSIGN_NE,  /* =!= */
+
+    TOK_COUNT
+};
+
+struct token {
+    enum token_kind kind;
+    const char *text; /* start of the token in the source buffer */
+    size_t length; /* length of the token's source text */
+
+    const char *name; /* TOK_IDENT: interned identifier */
+    intptr_t value; /* TOK_NUMBER, TOK_CHAR: value of the literal; TOK_STRING: index in the string table */
+};
+
+struct lexer {
+    struct compiler_ctx *ctx; /* its position follows the current token on every advance */
+    unsigned char word_size; /* size of the B data type */
+
+    const char *start; /* beginning of the source buffer */
+    const char *cur; /* next character to scan */
+    const char *end; /* end of the source buffer */
+
+    struct token tok; /* current token */
+    const char *prev_end; /* end of the token before `tok` */
+    struct token ahead; /* one token of lookahead, valid if `has_ahead` */
+    bool has_ahead;
+
+    struct intern_table idents; /* interned identifiers */
+    char *buf; /* decoded contents of the last string literal */
+    size_t buf_size; /* allocated size of `buf` */
+};
+
+//
+// Start scanning `data` at `ctx->pos.offset` and read the first token.
+//
+void lexer_init(struct lexer *lex, struct compiler_ctx *ctx, unsigned char word_size, const char *data, size_t size);
+void lexer_free(struct lexer *lex);
+
+//
+// Advance to the next token.
+//
+void lexer_next(struct lexer *lex);
+
+//
+// Return the token after the current one without consuming anything.
+//
+const struct token *lexer_peek(struct lexer *lex);
+
+//
+// Point the position right behind the previous token, where a token that
+// turned out to be missing (like a `;`) was expected.
+//
+void lexer_pos_missing(struct lexer *lex);
+
+#endif /* BCAUSE_LEXER_H */
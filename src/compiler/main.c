@@ -2,6 +2,8 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "compiler.h"
 
@@ -31,8 +33,15 @@ static inline void help(char *arg0)
         "-L<dir>      Location of B library.\n"
         "-S           Compile only; do not assemble or link.\n"
         "-c           Compile and assemble, but do not link.\n"
-        "--save-temps Do not delete intermediate files.\n",
-        arg0
+        "-j<N>        Compile large files using <N> threads.\n"
+        "-O<level>    Optimization level 0, 1 or 2; -O is -O1 (default -O0).\n"
+        "--inline-limit=<n>\n"
+        "             Inline functions of up to <n> instructions at -O2 (default %d);\n"
+        "             0 disables inlining.\n"
+        "--dump-ir    Print the intermediate code of optimized functions.\n"
+        "--save-temps Do not delete intermediate files.\n"
+        "--mem-report Print the peak memory used for syntax trees.\n",
+        arg0, DEFAULT_INLINE_LIMIT
     );
 }
 
@@ -47,6 +56,10 @@ static inline void set_default_args(struct compiler_args *args, const char *arg0
     args->input_files = input_files;
     args->do_assembling = args->do_linking = true;
     args->word_size = X86_64_WORD_SIZE;
+    args->inline_limit = DEFAULT_INLINE_LIMIT;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    args->jobs = cpus > 0 ? cpus : 1;
 }
 
 int main(int argc, char **argv)
@@ -85,8 +98,39 @@ int main(int argc, char **argv)
             c_args.output_file = A_O;
             c_args.do_linking = false;
         }
+        else if(strncmp(argv[i], "-j", 2) == 0) {
+            char *end;
+            long jobs = strtol(argv[i] + 2, &end, 10);
+            if(argv[i][2] == '\0' || *end || jobs < 1) {
+                eprintf(argv[0], "expect thread count after " QUOTE_FMT("-j") "\n");
+                return 1;
+            }
+            c_args.jobs = jobs;
+        }
+        else if(strncmp(argv[i], "-O", 2) == 0) {
+            char *end;
+            long level = argv[i][2] ? strtol(argv[i] + 2, &end, 10) : 1;
+            if(argv[i][2] && (*end || level < 0)) {
+                eprintf(argv[0], "invalid optimization level " QUOTE_FMT("%s") "\n", argv[i]);
+                return 1;
+            }
+            c_args.opt_level = level > MAX_OPT_LEVEL ? MAX_OPT_LEVEL : level;
+        }
+        else if(strncmp(argv[i], "--inline-limit=", 15) == 0) {
+            char *end;
+            long limit = strtol(argv[i] + 15, &end, 10);
+            if(argv[i][15] == '\0' || *end || limit < 0 || limit > 100000) {
+                eprintf(argv[0], "invalid inline limit " QUOTE_FMT("%s") "\n", argv[i]);
+                return 1;
+            }
+            c_args.inline_limit = limit;
+        }
+        else if(strcmp(argv[i], "--dump-ir") == 0)
+            c_args.dump_ir = true;
         else if(strcmp(argv[i], "--save-temps") == 0)
             c_args.save_temps = true;
+        else if(strcmp(argv[i], "--mem-report") == 0)
+            c_args.mem_report = true;
         else if(argv[i][0] == '-') {
             eprintf(argv[0], "unrecognized command-line option " QUOTE_FMT("%s") "\n", argv[i]);
             return 1;
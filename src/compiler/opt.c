@@ -0,0 +1,1263 @@
+#include "opt.h"
+#include "inline.h"
+#include "list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct pass {
+    const char *name;
+    void (*run)(struct ir_function *fn);
+    unsigned char level; /* lowest optimization level the pass runs at */
+};
+
+//
+// The pipeline, in the order the passes run.
+//
+static const struct pass passes[] = {
+    { "simplify-cfg", simplify_cfg, 1 },
+    { "mem2reg", promote_slots, 1 },
+    { "rotate", rotate_loops, 1 },
+    { "sccp", propagate_constants, 1 },
+    { "dce", eliminate_dead_code, 1 },
+    { "simplify-cfg", simplify_cfg, 1 },
+};
+
+//
+// Rounds of inlining: bodies inlined in one round may have calls that are
+// inlined in the next one.
+//
+#define INLINE_ROUNDS 3
+
+static void run_passes(struct ir_function *fn, unsigned char level)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(passes) / sizeof(struct pass); i++) {
+        if (level < passes[i].level)
+            continue;
+        passes[i].run(fn);
+#ifdef IR_VERIFY
+        ir_verify(fn, passes[i].name);
+#endif
+    }
+}
+
+void optimize(struct ir_function *fn, unsigned char level, const struct inliner *inl)
+{
+    unsigned round;
+
+#ifdef IR_VERIFY
+    ir_verify(fn, "ir_build");
+#endif
+
+    // the arguments are still stored to their slots, so mem2reg gives the
+    // loops it makes their phi nodes
+    if (level >= 1) {
+        eliminate_tail_recursion(fn);
+#ifdef IR_VERIFY
+        ir_verify(fn, "tailrec");
+#endif
+    }
+
+    run_passes(fn, level);
+
+    // the callees are optimized already, the code around them is run
+    // through the passes again
+    for (round = 0; level >= 2 && round < INLINE_ROUNDS && inline_calls(fn, inl); round++) {
+#ifdef IR_VERIFY
+        ir_verify(fn, "inline");
+#endif
+        run_passes(fn, level);
+    }
+}
+
+//
+// Delete the blocks that cannot be reached from the entry block.
+// Return whether there were any.
+//
+static bool remove_unreachable(struct ir_function *fn)
+{
+    bool *reached = calloc(fn->num_blocks, sizeof(bool)), changed = false;
+    struct ir_block **stack = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    struct ir_block *bb, *next;
+    size_t n = 0;
+    unsigned i;
+
+    reached[fn->entry->id] = true;
+    stack[n++] = fn->entry;
+    while (n) {
+        bb = stack[--n];
+        for (i = 0; i < bb->num_succs; i++) {
+            if (!reached[bb->succs[i]->id]) {
+                reached[bb->succs[i]->id] = true;
+                stack[n++] = bb->succs[i];
+            }
+        }
+    }
+
+    for (bb = fn->entry; bb; bb = next) {
+        next = bb->next;
+        if (!reached[bb->id]) {
+            ir_remove_block(fn, bb);
+            changed = true;
+        }
+    }
+
+    free(reached);
+    free(stack);
+    return changed;
+}
+
+//
+// Append the only successor of `bb` to it, if `bb` is its only predecessor.
+// Return whether it was.
+//
+static bool merge_successor(struct ir_function *fn, struct ir_block *bb)
+{
+    struct ir_block *succ;
+    struct ir_inst *inst;
+    unsigned i;
+
+    if (bb->last->op != IR_JMP || (succ = bb->succs[0]) == bb || succ->num_preds != 1)
+        return false;
+
+    while ((inst = succ->first)->op == IR_PHI) {
+        ir_replace_uses(inst, inst->args[0].value);
+        ir_remove(inst);
+    }
+
+    ir_remove(bb->last);
+    while ((inst = succ->first)) {
+        ir_unlink(inst);
+        ir_append(bb, inst);
+    }
+
+    // the edges leaving `succ` now leave `bb`
+    bb->succs = succ->succs;
+    bb->num_succs = succ->num_succs;
+    for (i = 0; i < bb->num_succs; i++)
+        bb->succs[i]->preds[ir_pred_index(bb->succs[i], succ)] = bb;
+
+    succ->num_succs = succ->num_preds = 0;
+    ir_remove_block(fn, succ);
+    return true;
+}
+
+//
+// Lead the edges entering `bb`, which does nothing but jump, straight to
+// its successor. Edges from blocks that already jump to the successor stay
+// if the successor has phi nodes, which could not tell them apart.
+// Return whether any edge was moved.
+//
+static bool bypass(struct ir_function *fn, struct ir_block *bb)
+{
+    struct ir_block *target = bb->succs[0], *pred;
+    struct ir_inst *phi, **values = NULL;
+    unsigned i, j, num_phis = 0;
+    int from = ir_pred_index(target, bb);
+    bool changed = false;
+
+    ir_foreach_phi(phi, target)
+        num_phis++;
+    if (num_phis) {
+        values = malloc(num_phis * sizeof(struct ir_inst*));
+        num_phis = 0;
+        ir_foreach_phi(phi, target)
+            values[num_phis++] = phi->args[from].value;
+    }
+
+    for (i = 0; i < bb->num_preds;) {
+        pred = bb->preds[i];
+        if (pred == bb || (num_phis && ir_pred_index(target, pred) >= 0)) {
+            i++;
+            continue;
+        }
+
+        // this removes `pred` from the predecessors of `bb`, at index `i`
+        for (j = 0; pred->succs[j] != bb; j++);
+        ir_retarget(fn, pred, j, target, values);
+        changed = true;
+    }
+
+    free(values);
+    return changed;
+}
+
+//
+// Let the blocks that jump to `bb`, which only returns the value of its
+// phi node, right after a call whose value the phi node takes from them
+// return that value themselves, so the call is in tail position.
+// Return whether any did.
+//
+static bool return_calls(struct ir_function *fn, struct ir_block *bb)
+{
+    struct ir_inst *phi = bb->first, *call;
+    struct ir_block *pred;
+    bool changed = false;
+    unsigned i = 0;
+
+    if (phi->op != IR_PHI || phi->next != bb->last || bb->last->op != IR_RET || bb->last->args[0].value != phi)
+        return false;
+
+    while (i < bb->num_preds) {
+        pred = bb->preds[i];
+        call = phi->args[i].value;
+        if (pred->last->op != IR_JMP || pred->last->prev != call || call->op != IR_CALL) {
+            i++;
+            continue;
+        }
+        ir_remove_pred(bb, i);
+        ir_remove(pred->last);
+        pred->succs = NULL;
+        pred->num_succs = 0;
+        ir_ret(fn, pred, call);
+        changed = true;
+    }
+    return changed;
+}
+
+void simplify_cfg(struct ir_function *fn)
+{
+    struct ir_block *bb;
+    struct ir_inst *phi;
+    bool changed;
+
+    do {
+        changed = remove_unreachable(fn);
+
+        for (bb = fn->entry; bb; bb = bb->next) {
+            // a phi node with a single operand is that operand
+            while (bb->num_preds == 1 && (phi = bb->first)->op == IR_PHI) {
+                ir_replace_uses(phi, phi->args[0].value);
+                ir_remove(phi);
+            }
+
+            if (bb->last->op == IR_BR && bb->succs[0] == bb->succs[1]) {
+                ir_make_jmp(fn, bb, 0);
+                changed = true;
+            }
+
+            while (merge_successor(fn, bb))
+                changed = true;
+
+            changed |= return_calls(fn, bb);
+
+            if (bb != fn->entry && bb->first == bb->last && bb->last->op == IR_JMP && bb->succs[0] != bb)
+                changed |= bypass(fn, bb);
+        }
+    } while (changed);
+}
+
+void eliminate_dead_code(struct ir_function *fn)
+{
+    bool *live = calloc(fn->num_insts, sizeof(bool));
+    struct ir_inst **work = malloc(fn->num_insts * sizeof(struct ir_inst*));
+    struct ir_block *bb;
+    struct ir_inst *inst, *next;
+    size_t n = 0;
+    unsigned i;
+
+    // what has side effects is live, and so is everything it uses;
+    // cycles of phi nodes nothing else uses die with this
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (ir_has_side_effects(inst->op)) {
+                live[inst->id] = true;
+                work[n++] = inst;
+            }
+
+    while (n) {
+        inst = work[--n];
+        for (i = 0; i < inst->num_args; i++) {
+            if (!live[inst->args[i].value->id]) {
+                live[inst->args[i].value->id] = true;
+                work[n++] = inst->args[i].value;
+            }
+        }
+    }
+
+    // drop the operands first, so that no dead value is used when it goes
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (!live[inst->id])
+                while (inst->num_args)
+                    ir_remove_arg(inst, inst->num_args - 1);
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = next) {
+            next = inst->next;
+            if (!live[inst->id])
+                ir_remove(inst);
+        }
+    }
+
+    free(live);
+    free(work);
+}
+
+//
+// Tell whether all uses of a stack slot address load from or store to the
+// slot, which then behaves like a variable.
+//
+static bool is_promotable(const struct ir_inst *slot)
+{
+    const struct ir_use *use;
+
+    for (use = slot->uses; use; use = use->next) {
+        if (use->user->op != IR_LOAD && use->user->op != IR_STORE)
+            return false;
+        if (use != &use->user->args[0])
+            return false;
+    }
+    return true;
+}
+
+//
+// Tell whether a stack slot address is only used to initialize the pointer
+// to a vector, in the slot above the vector.
+//
+static bool is_vector_base(const struct ir_inst *slot)
+{
+    const struct ir_use *use;
+    const struct ir_inst *ptr;
+
+    for (use = slot->uses; use; use = use->next) {
+        if (use->user->op != IR_STORE || use != &use->user->args[1])
+            return false;
+        ptr = use->user->args[0].value;
+        if (ptr->op != IR_SLOT || ptr->imm != slot->imm + 1)
+            return false;
+    }
+    return true;
+}
+
+struct mem2reg {
+    struct ir_function *fn;
+    bool *promoted; /* per slot */
+    struct ir_inst **current; /* value of each promoted slot at this point */
+    struct ir_inst *undefined; /* value of a slot before it is first stored to */
+    struct ir_block **children; /* children in the dominator tree, by block */
+    unsigned *first_child, *num_children; /* indexes into `children` */
+    bool *inserted; /* by instruction, phi nodes made for a slot */
+};
+
+//
+// Put phi nodes for promoted slots at the iterated dominance frontier of
+// the blocks storing to them.
+//
+static void insert_phis(struct mem2reg *m, struct ir_block **order, unsigned n)
+{
+    struct ir_function *fn = m->fn;
+    struct list *frontier = calloc(fn->num_blocks, sizeof(struct list));
+    struct list *stores = calloc(fn->num_slots, sizeof(struct list));
+    unsigned *has_phi = calloc(fn->num_blocks, sizeof(unsigned));
+    unsigned *queued = calloc(fn->num_blocks, sizeof(unsigned));
+    struct ir_block *bb, *runner, *df, **work = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    struct ir_inst *inst, *phi;
+    size_t w, k;
+    uintmax_t slot;
+    unsigned i, j;
+
+    for (i = 0; i < n; i++) {
+        bb = order[i];
+        for (j = 0; j < bb->num_preds && bb->num_preds > 1; j++) {
+            for (runner = bb->preds[j]; runner->idom && runner != bb->idom; runner = runner->idom) {
+                if (frontier[runner->id].size && frontier[runner->id].data[frontier[runner->id].size - 1] == bb)
+                    continue;
+                list_push(&frontier[runner->id], bb);
+            }
+        }
+
+        for (inst = bb->first; inst; inst = inst->next)
+            if (inst->op == IR_STORE && inst->args[0].value->op == IR_SLOT
+                    && inst->args[0].value->imm >= 0 && m->promoted[inst->args[0].value->imm])
+                list_push(&stores[inst->args[0].value->imm], bb);
+    }
+
+    // has_phi and queued hold the slot number plus one they were last set for
+    for (slot = 0; slot < fn->num_slots; slot++) {
+        if (!m->promoted[slot])
+            continue;
+
+        for (k = w = 0; k < stores[slot].size; k++) {
+            bb = stores[slot].data[k];
+            if (queued[bb->id] != slot + 1) {
+                queued[bb->id] = slot + 1;
+                work[w++] = bb;
+            }
+        }
+
+        while (w) {
+            bb = work[--w];
+            for (k = 0; k < frontier[bb->id].size; k++) {
+                df = frontier[bb->id].data[k];
+                if (has_phi[df->id] == slot + 1)
+                    continue;
+                has_phi[df->id] = slot + 1;
+
+                phi = ir_emit_imm(fn, df, IR_PHI, slot);
+                for (i = 0; i < df->num_preds; i++)
+                    ir_add_arg(fn, phi, m->undefined);
+
+                if (queued[df->id] != slot + 1) {
+                    queued[df->id] = slot + 1;
+                    work[w++] = df;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < fn->num_blocks; i++)
+        list_free(&frontier[i]);
+    for (slot = 0; slot < fn->num_slots; slot++)
+        list_free(&stores[slot]);
+    free(frontier);
+    free(stores);
+    free(has_phi);
+    free(queued);
+    free(work);
+}
+
+//
+// Replace the loads and stores of promoted slots in `bb` with the values
+// they transfer, and give the phi nodes of the successors their operands.
+// Append the slots whose values changed to `changed`, for undoing.
+//
+static void rename_block(struct mem2reg *m, struct ir_block *bb, struct list *changed)
+{
+    struct ir_inst *inst, *next, *phi;
+    struct ir_block *succ;
+    intptr_t slot;
+    unsigned i, j;
+
+    for (inst = bb->first; inst; inst = next) {
+        next = inst->next;
+        if (inst->op == IR_PHI && m->inserted[inst->id])
+            slot = inst->imm;
+        else if ((inst->op == IR_LOAD || inst->op == IR_STORE) && inst->args[0].value->op == IR_SLOT)
+            slot = inst->args[0].value->imm;
+        else
+            continue;
+        if (slot < 0 || !m->promoted[slot])
+            continue;
+
+        switch (inst->op) {
+        case IR_PHI:
+            list_push(changed, (void*) slot);
+            list_push(changed, m->current[slot]);
+            m->current[slot] = inst;
+            break;
+        case IR_LOAD:
+            ir_replace_uses(inst, m->current[slot]);
+            ir_remove(inst);
+            break;
+        default:
+            list_push(changed, (void*) slot);
+            list_push(changed, m->current[slot]);
+            m->current[slot] = inst->args[1].value;
+            ir_remove(inst);
+        }
+    }
+
+    for (i = 0; i < bb->num_succs; i++) {
+        succ = bb->succs[i];
+        ir_foreach_phi(phi, succ) {
+            if (!m->inserted[phi->id])
+                continue;
+            for (j = 0; j < succ->num_preds; j++)
+                if (succ->preds[j] == bb)
+                    ir_set_arg(phi, j, m->current[phi->imm]);
+        }
+    }
+}
+
+//
+// Rename the promoted slots in the dominator tree, from the entry block down.
+//
+static void rename_slots(struct mem2reg *m)
+{
+    struct ir_function *fn = m->fn;
+    struct ir_block **stack = malloc(fn->num_blocks * sizeof(struct ir_block*)), *bb;
+    size_t *mark = malloc(fn->num_blocks * sizeof(size_t)), slot;
+    unsigned *next = calloc(fn->num_blocks, sizeof(unsigned));
+    struct list changed;
+    unsigned depth = 0;
+
+    memset(&changed, 0, sizeof(struct list));
+    stack[depth++] = fn->entry;
+    mark[0] = 0;
+    rename_block(m, fn->entry, &changed);
+
+    while (depth) {
+        bb = stack[depth - 1];
+        if (next[bb->id] < m->num_children[bb->id]) {
+            bb = m->children[m->first_child[bb->id] + next[bb->id]++];
+            mark[depth] = changed.size;
+            stack[depth++] = bb;
+            rename_block(m, bb, &changed);
+            continue;
+        }
+
+        // leaving the subtree restores the values from before it
+        depth--;
+        while (changed.size > mark[depth]) {
+            changed.size -= 2;
+            slot = (size_t) changed.data[changed.size];
+            m->current[slot] = changed.data[changed.size + 1];
+        }
+    }
+
+    list_free(&changed);
+    free(stack);
+    free(mark);
+    free(next);
+}
+
+//
+// Replace phi nodes for slots whose operands are all the same value, or the
+// phi node itself, with that value. Return whether there were any.
+//
+static bool remove_trivial_phis(struct mem2reg *m)
+{
+    struct ir_block *bb;
+    struct ir_inst *phi, *next, *same;
+    bool changed = false;
+    unsigned i;
+
+    for (bb = m->fn->entry; bb; bb = bb->next) {
+        for (phi = bb->first; phi && phi->op == IR_PHI; phi = next) {
+            next = phi->next;
+            if (!m->inserted[phi->id])
+                continue;
+
+            for (same = NULL, i = 0; i < phi->num_args; i++) {
+                if (phi->args[i].value == phi || phi->args[i].value == same)
+                    continue;
+                if (same)
+                    break;
+                same = phi->args[i].value;
+            }
+            if (i < phi->num_args || !same)
+                continue;
+
+            ir_replace_uses(phi, same);
+            while (phi->num_args)
+                ir_remove_arg(phi, phi->num_args - 1);
+            ir_remove(phi);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void promote_slots(struct ir_function *fn)
+{
+    struct mem2reg m = { fn, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+    struct ir_block **order, *bb;
+    struct ir_inst *inst, *pos;
+    unsigned i, n, num_insts;
+    bool any = false;
+
+    if (!fn->num_slots)
+        return;
+
+    // B lets a pointer to one auto reach its neighbours, so once the address
+    // of any slot but a vector escapes, every slot stays in memory
+    m.promoted = malloc(fn->num_slots * sizeof(bool));
+    memset(m.promoted, true, fn->num_slots * sizeof(bool));
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (inst->op != IR_SLOT || is_promotable(inst))
+                continue;
+            if (!is_vector_base(inst)) {
+                free(m.promoted);
+                return;
+            }
+            if (inst->imm >= 0)
+                m.promoted[inst->imm] = false;
+        }
+    }
+    for (i = 0; i < fn->num_slots; i++)
+        any |= m.promoted[i];
+    if (!any) {
+        free(m.promoted);
+        return;
+    }
+
+    order = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    n = ir_compute_dominators(fn, order);
+
+    // children of each block in the dominator tree, in reverse postorder
+    m.children = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    m.first_child = calloc(fn->num_blocks, sizeof(unsigned));
+    m.num_children = calloc(fn->num_blocks, sizeof(unsigned));
+    for (i = 1; i < n; i++)
+        m.num_children[order[i]->idom->id]++;
+    for (i = 0; i < n; i++)
+        m.first_child[order[i]->id] = i ? m.first_child[order[i - 1]->id] + m.num_children[order[i - 1]->id] : 0;
+    memset(m.num_children, 0, fn->num_blocks * sizeof(unsigned));
+    for (i = 1; i < n; i++) {
+        bb = order[i]->idom;
+        m.children[m.first_child[bb->id] + m.num_children[bb->id]++] = order[i];
+    }
+
+    // slots read before they are written to read zero, after the arguments
+    for (pos = fn->entry->first; pos->op == IR_PARAM; pos = pos->next);
+    m.undefined = ir_new_inst(fn, IR_CONST);
+    ir_insert_before(pos, m.undefined);
+
+    num_insts = fn->num_insts;
+    insert_phis(&m, order, n);
+    m.inserted = calloc(fn->num_insts, sizeof(bool));
+    for (i = num_insts; i < fn->num_insts; i++)
+        m.inserted[i] = true;
+
+    m.current = malloc(fn->num_slots * sizeof(struct ir_inst*));
+    for (i = 0; i < fn->num_slots; i++)
+        m.current[i] = m.undefined;
+    rename_slots(&m);
+
+    while (remove_trivial_phis(&m));
+
+    // the slot numbers were only needed to tell the phi nodes apart
+    for (bb = fn->entry; bb; bb = bb->next)
+        ir_foreach_phi(inst, bb)
+            inst->imm = 0;
+
+    free(m.promoted);
+    free(m.current);
+    free(m.children);
+    free(m.first_child);
+    free(m.num_children);
+    free(m.inserted);
+    free(order);
+}
+
+//
+// Tell whether `call`, just before the return of its value, calls `fn`.
+//
+static bool is_self_tail_call(const struct ir_function *fn, const struct ir_inst *call)
+{
+    const struct ir_inst *ret = call->next;
+
+    return call->op == IR_CALL && call->args[0].value->op == IR_GLOBAL && !strcmp(call->args[0].value->name, fn->name)
+        && ret && ret->op == IR_RET && ret->args[0].value == call;
+}
+
+//
+// Split the entry block after the arguments are stored to their slots,
+// and return the block with the rest.
+//
+static struct ir_block *split_entry(struct ir_function *fn)
+{
+    struct ir_block *entry = fn->entry, *body = ir_new_block(fn), *succ;
+    struct ir_inst *inst, *next;
+    unsigned i, j;
+
+    for (inst = entry->first, next = entry->first; inst; inst = inst->next)
+        if (inst->op == IR_STORE && inst->args[1].value->op == IR_PARAM)
+            next = inst->next;
+    for (inst = next; inst; inst = next) {
+        next = inst->next;
+        ir_unlink(inst);
+        ir_append(body, inst);
+    }
+
+    body->succs = entry->succs;
+    body->num_succs = entry->num_succs;
+    for (i = 0; i < body->num_succs; i++) {
+        succ = body->succs[i];
+        for (j = 0; j < succ->num_preds; j++)
+            if (succ->preds[j] == entry)
+                succ->preds[j] = body;
+    }
+    entry->succs = NULL;
+    entry->num_succs = 0;
+    ir_jmp(fn, entry, body);
+    ir_move_block_after(fn, body, entry);
+    return body;
+}
+
+void eliminate_tail_recursion(struct ir_function *fn)
+{
+    struct ir_block *bb, *body = NULL;
+    struct ir_inst *inst, *args[MAX_FN_CALL_ARGS];
+    unsigned i, n;
+
+    // a frame that is reused must not be seen from elsewhere
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (inst->op == IR_SLOT && !is_promotable(inst))
+                return;
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (!is_self_tail_call(fn, inst))
+                continue;
+
+            if (!body) {
+                body = split_entry(fn);
+                if (bb == fn->entry)
+                    bb = body;
+            }
+
+            n = inst->num_args - 1 < fn->num_args ? inst->num_args - 1 : fn->num_args;
+            for (i = 0; i < n; i++)
+                args[i] = inst->args[i + 1].value;
+            ir_remove(inst->next);
+            ir_remove(inst);
+
+            // arguments left out keep the values they had
+            for (i = 0; i < n; i++)
+                ir_emit_binary(fn, bb, IR_STORE, ir_emit_imm(fn, bb, IR_SLOT, i), args[i]);
+            ir_jmp(fn, bb, body);
+            break;
+        }
+    }
+}
+
+//
+// Loop headers with more instructions than this are not copied.
+//
+#define MAX_ROTATED 12
+
+//
+// Tell whether every path from the entry block to `b` goes through `a`.
+//
+static bool dominates(const struct ir_block *a, const struct ir_block *b)
+{
+    while (b->order > a->order)
+        b = b->idom;
+    return a == b;
+}
+
+//
+// Find the block where a use reads its value: the end of the predecessor
+// for phi nodes.
+//
+static struct ir_block *use_block(const struct ir_use *use)
+{
+    const struct ir_inst *user = use->user;
+
+    return user->op == IR_PHI ? user->block->preds[use - user->args] : user->block;
+}
+
+//
+// Find the successor of the test `head` that leads back to it, the body, and
+// the other one in `succ`. Every block jumping back must be in the body, and
+// the loop must be entered from elsewhere too. Return how many blocks jump
+// back, or 0 if `head` does not start a loop like that.
+//
+static unsigned find_body(struct ir_block *head, struct ir_block **succ)
+{
+    unsigned i, k, n;
+
+    if (head->last->op != IR_BR || head->succs[0] == head->succs[1]
+            || head->succs[0] == head || head->succs[1] == head)
+        return 0;
+
+    for (k = 0; k < 2; k++) {
+        succ[0] = head->succs[k];
+        succ[1] = head->succs[1 - k];
+        for (i = 0, n = 0; i < head->num_preds; i++) {
+            if (!dominates(head, head->preds[i]))
+                continue;
+            if (!dominates(succ[0], head->preds[i]))
+                break;
+            n++;
+        }
+        if (i == head->num_preds && n && n < head->num_preds)
+            return n;
+    }
+    return 0;
+}
+
+//
+// Tell whether the test `head` is small enough to copy, and its values are
+// only used in it or where one of its successors `succ`, entered only from
+// it, leads.
+//
+static bool is_rotatable(const struct ir_block *head, struct ir_block *const *succ)
+{
+    const struct ir_inst *inst;
+    const struct ir_use *use;
+    const struct ir_block *bb;
+    unsigned k, n = 0;
+
+    for (inst = head->first; inst != head->last; inst = inst->next) {
+        if (inst->op != IR_PHI && ++n > MAX_ROTATED)
+            return false;
+        for (use = inst->uses; use; use = use->next) {
+            bb = use_block(use);
+            for (k = 0; k < 2 && bb != head; k++)
+                if (succ[k]->num_preds == 1 && dominates(succ[k], bb))
+                    break;
+            if (k == 2)
+                return false;
+        }
+    }
+    return true;
+}
+
+//
+// Make the blocks jumping back to the loop test `head` jump to a new block,
+// after the last of them, that jumps there instead, and return it. The
+// operands of the phi nodes of `head` that differ between them come from phi
+// nodes of the new block.
+//
+static struct ir_block *merge_latches(struct ir_function *fn, struct ir_block *head)
+{
+    struct ir_block *latch = ir_new_block(fn), *bb, *last = NULL;
+    struct ir_inst *phi, **merged, **same, **values;
+    unsigned i, j, k, n = 0;
+
+    for (bb = fn->entry; bb != latch; bb = bb->next)
+        if (ir_pred_index(head, bb) >= 0 && dominates(head, bb))
+            last = bb;
+    ir_foreach_phi(phi, head)
+        n++;
+    merged = calloc(n, sizeof(struct ir_inst*));
+    same = calloc(n, sizeof(struct ir_inst*));
+    values = malloc(n * sizeof(struct ir_inst*));
+
+    j = 0;
+    ir_foreach_phi(phi, head) {
+        for (i = 0; i < head->num_preds; i++) {
+            if (!dominates(head, head->preds[i]))
+                continue;
+            if (same[j] && same[j] != phi->args[i].value && !merged[j])
+                merged[j] = ir_emit(fn, latch, IR_PHI);
+            same[j] = phi->args[i].value;
+        }
+        j++;
+    }
+
+    for (i = 0; i < head->num_preds;) {
+        bb = head->preds[i];
+        if (!dominates(head, bb)) {
+            i++;
+            continue;
+        }
+        j = k = 0;
+        ir_foreach_phi(phi, head) {
+            if (merged[j++])
+                values[k++] = phi->args[i].value;
+        }
+        for (k = 0; bb->succs[k] != head; k++);
+        ir_retarget(fn, bb, k, latch, values);
+    }
+
+    ir_jmp(fn, latch, head);
+    j = 0;
+    ir_foreach_phi(phi, head) {
+        ir_add_arg(fn, phi, merged[j] ? merged[j] : same[j]);
+        j++;
+    }
+    ir_move_block_after(fn, latch, last);
+
+    free(merged);
+    free(same);
+    free(values);
+    return latch;
+}
+
+//
+// Give a loop that rotate() could take but for its shape a single block
+// jumping back, and put a block of its own on the edges from the test to
+// successors entered from elsewhere as well or with phi nodes. Return
+// whether anything changed.
+//
+static bool prepare_rotation(struct ir_function *fn, struct ir_block *head)
+{
+    struct ir_block *succ[2], *latch = NULL, *split;
+    unsigned i, n = find_body(head, succ);
+    bool changed = false;
+
+    if (!n || !is_rotatable(head, succ))
+        return false;
+
+    // a loop that already ends in a test stays as it is
+    for (i = 0; i < head->num_preds; i++)
+        if (dominates(head, head->preds[i]))
+            latch = head->preds[i];
+    if (n == 1 && latch->last->op != IR_JMP)
+        return false;
+    if (n > 1) {
+        latch = merge_latches(fn, head);
+        changed = true;
+    }
+
+    // the body follows the test, and the exit the end of the body
+    for (i = 0; i < 2; i++) {
+        if (head->succs[i]->num_preds > 1 || head->succs[i]->first->op == IR_PHI) {
+            split = ir_split_edge(fn, head, i);
+            ir_move_block_after(fn, split, head->succs[i] == succ[0] ? head : latch);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+//
+// If `head` is the test at the top of a loop, entered from elsewhere and
+// from the end of the body `latch` that jumps back to it, copy the test to
+// the end of the body. The loop then branches back from the bottom, and the
+// test at the top only guards the first entry. Values of the test used in
+// the body or after the loop now come from either copy, through new phi
+// nodes at the top of the body and of the exit.
+// Return whether the loop was rotated.
+//
+static bool rotate(struct ir_function *fn, struct ir_block *head)
+{
+    struct ir_block *latch = NULL, *succ[2], *bb;
+    struct ir_inst *inst, *value, *copy, **map, **body_phi, *exit_phi;
+    struct ir_use *use, *next;
+    unsigned i, k;
+    bool used;
+    int l;
+
+    if (find_body(head, succ) != 1 || !is_rotatable(head, succ))
+        return false;
+    for (i = 0; i < head->num_preds; i++)
+        if (dominates(head, head->preds[i]))
+            latch = head->preds[i];
+    if (latch->last->op != IR_JMP)
+        return false;
+    for (k = 0; k < 2; k++)
+        if (succ[k]->num_preds != 1 || succ[k]->first->op == IR_PHI)
+            return false;
+
+    l = ir_pred_index(head, latch);
+
+    // a value of the test that goes around the loop is the one of the
+    // copy that ran last, which a phi node at the top of the body picks
+    map = malloc(fn->num_insts * sizeof(struct ir_inst*));
+    body_phi = calloc(fn->num_insts, sizeof(struct ir_inst*));
+    ir_foreach_phi(inst, head) {
+        value = inst->args[l].value;
+        if (value->block == head && !body_phi[value->id]) {
+            body_phi[value->id] = ir_emit(fn, succ[0], IR_PHI);
+            ir_add_arg(fn, body_phi[value->id], value);
+        }
+    }
+
+    // the copy at the end of the body starts from the values the phi
+    // nodes take from it
+    ir_remove(latch->last);
+    latch->succs = NULL;
+    latch->num_succs = 0;
+    for (inst = head->first; inst != head->last; inst = inst->next) {
+        if (inst->op == IR_PHI) {
+            value = inst->args[l].value;
+            map[inst->id] = value->block == head ? body_phi[value->id] : value;
+            continue;
+        }
+        copy = ir_emit(fn, latch, inst->op);
+        copy->imm = inst->imm;
+        copy->name = inst->name;
+        copy->vector = inst->vector;
+        for (i = 0; i < inst->num_args; i++) {
+            value = inst->args[i].value;
+            ir_add_arg(fn, copy, value->block == head ? map[value->id] : value);
+        }
+        map[inst->id] = copy;
+    }
+    value = head->last->args[0].value;
+    ir_remove_pred(head, l);
+    ir_br(fn, latch, value->block == head ? map[value->id] : value, head->succs[0], head->succs[1]);
+
+    for (inst = head->first; inst != head->last; inst = inst->next) {
+        if (body_phi[inst->id])
+            ir_add_arg(fn, body_phi[inst->id], map[inst->id]);
+
+        used = false;
+        for (use = inst->uses; use; use = use->next)
+            if ((bb = use_block(use)) != head && !dominates(succ[0], bb))
+                used = true;
+        exit_phi = NULL;
+        if (used) {
+            exit_phi = ir_emit(fn, succ[1], IR_PHI);
+            ir_add_arg(fn, exit_phi, inst);
+            ir_add_arg(fn, exit_phi, map[inst->id]);
+        }
+
+        for (use = inst->uses; use; use = next) {
+            next = use->next;
+            if (use->user == exit_phi || (bb = use_block(use)) == head || (body_phi[inst->id] && use->user == body_phi[inst->id]))
+                continue;
+            if (dominates(succ[0], bb) && !body_phi[inst->id]) {
+                body_phi[inst->id] = ir_emit(fn, succ[0], IR_PHI);
+                ir_add_arg(fn, body_phi[inst->id], inst);
+                ir_add_arg(fn, body_phi[inst->id], map[inst->id]);
+            }
+            ir_set_arg(use->user, use - use->user->args, dominates(succ[0], bb) ? body_phi[inst->id] : exit_phi);
+        }
+    }
+
+    free(map);
+    free(body_phi);
+    return true;
+}
+
+void rotate_loops(struct ir_function *fn)
+{
+    struct ir_block **order = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    struct ir_block *bb;
+
+    ir_compute_dominators(fn, order);
+    for (bb = fn->entry; bb; bb = bb->next) {
+        if (prepare_rotation(fn, bb)) {
+            // the new blocks need dominators too
+            order = realloc(order, fn->num_blocks * sizeof(struct ir_block*));
+            ir_compute_dominators(fn, order);
+        }
+        if (rotate(fn, bb))
+            ir_compute_dominators(fn, order);
+    }
+    free(order);
+}
+
+//
+// What constant propagation knows about a value: nothing yet, that it is
+// always the same constant, or that it varies.
+//
+enum lattice {
+    UNKNOWN,
+    CONSTANT,
+    VARYING,
+};
+
+struct sccp {
+    struct ir_function *fn;
+    enum lattice *state; /* by instruction */
+    intptr_t *value; /* by instruction, the constant if CONSTANT */
+    bool *reached; /* by block, whether it can be executed */
+    struct list blocks; /* blocks reached but not visited yet */
+    struct list insts; /* instructions to visit again */
+};
+
+//
+// Compute a binary operator or negation like the code generated for it
+// would. Return false if that would trap.
+//
+static bool fold(enum ir_op op, intptr_t a, intptr_t b, intptr_t *result)
+{
+    uintptr_t ua = a, ub = b;
+
+    switch (op) {
+    case IR_ADD: *result = ua + ub; break;
+    case IR_SUB: *result = ua - ub; break;
+    case IR_MUL: *result = ua * ub; break;
+    case IR_DIV:
+    case IR_MOD:
+        if (b == 0 || (a == INTPTR_MIN && b == -1))
+            return false;
+        *result = op == IR_DIV ? a / b : a % b;
+        break;
+    case IR_SHL: *result = ua << (b & 63); break;
+    case IR_SAR: *result = a >> (b & 63); break;
+    case IR_AND: *result = a & b; break;
+    case IR_OR: *result = a | b; break;
+    case IR_LT: *result = a < b; break;
+    case IR_LE: *result = a <= b; break;
+    case IR_GT: *result = a > b; break;
+    case IR_GE: *result = a >= b; break;
+    case IR_EQ: *result = a == b; break;
+    case IR_NE: *result = a != b; break;
+    case IR_NEG: *result = -ua; break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+//
+// Return the outgoing edge a branch or switch takes for the operand `value`.
+//
+static unsigned taken_edge(const struct ir_inst *term, intptr_t value)
+{
+    unsigned i;
+
+    if (term->op == IR_BR)
+        return value ? 0 : 1;
+    for (i = 1; i < term->block->num_succs; i++)
+        if (term->cases[i] == value)
+            return i;
+    return 0;
+}
+
+//
+// Tell whether control can go from `pred` to its successor `bb` as far as
+// is known, from the operand of the terminator of `pred`.
+//
+static bool can_take(const struct sccp *s, const struct ir_block *pred, const struct ir_block *bb)
+{
+    const struct ir_inst *term = pred->last, *cond;
+
+    if (!s->reached[pred->id])
+        return false;
+    if (term->op != IR_BR && term->op != IR_SWITCH)
+        return true;
+
+    cond = term->args[0].value;
+    if (s->state[cond->id] == VARYING)
+        return true;
+    if (s->state[cond->id] == UNKNOWN)
+        return false;
+    return pred->succs[taken_edge(term, s->value[cond->id])] == bb;
+}
+
+//
+// Make the edge from a reached block to `bb` executable.
+//
+static void take(struct sccp *s, struct ir_block *bb)
+{
+    struct ir_inst *phi;
+
+    if (!s->reached[bb->id]) {
+        s->reached[bb->id] = true;
+        list_push(&s->blocks, bb);
+    }
+    else {
+        // a phi node has one more operand to look at
+        ir_foreach_phi(phi, bb)
+            list_push(&s->insts, phi);
+    }
+}
+
+//
+// Record what is known about a value, and revisit its users if that changed.
+//
+static void set_state(struct sccp *s, const struct ir_inst *inst, enum lattice state, intptr_t value)
+{
+    const struct ir_use *use;
+
+    if (state == s->state[inst->id] && (state != CONSTANT || value == s->value[inst->id]))
+        return;
+    s->state[inst->id] = state;
+    s->value[inst->id] = value;
+    for (use = inst->uses; use; use = use->next)
+        list_push(&s->insts, use->user);
+}
+
+//
+// Find out what can be known about the value of an instruction in a reached
+// block, or where control can go from a terminator.
+//
+static void visit(struct sccp *s, struct ir_inst *inst)
+{
+    struct ir_block *bb = inst->block;
+    enum lattice state = CONSTANT;
+    const struct ir_inst *arg;
+    intptr_t value = 0;
+    unsigned i;
+
+    switch (inst->op) {
+    case IR_CONST:
+        value = inst->imm;
+        break;
+
+    case IR_PHI:
+        state = UNKNOWN;
+        for (i = 0; i < inst->num_args && state != VARYING; i++) {
+            arg = inst->args[i].value;
+            if (!can_take(s, bb->preds[i], bb) || s->state[arg->id] == UNKNOWN)
+                continue;
+            if (s->state[arg->id] == VARYING || (state == CONSTANT && value != s->value[arg->id]))
+                state = VARYING;
+            else {
+                state = CONSTANT;
+                value = s->value[arg->id];
+            }
+        }
+        break;
+
+    case IR_JMP:
+    case IR_BR:
+    case IR_SWITCH:
+        for (i = 0; i < bb->num_succs; i++)
+            if (can_take(s, bb, bb->succs[i]))
+                take(s, bb->succs[i]);
+        return;
+
+    default:
+        if (!ir_is_binary(inst->op) && inst->op != IR_NEG) {
+            state = VARYING;
+            break;
+        }
+        for (i = 0; i < inst->num_args; i++) {
+            arg = inst->args[i].value;
+            if (s->state[arg->id] == VARYING) {
+                state = VARYING;
+                break;
+            }
+            if (s->state[arg->id] == UNKNOWN)
+                state = UNKNOWN;
+        }
+        if (state == CONSTANT && !fold(inst->op, s->value[inst->args[0].value->id],
+                                       inst->num_args > 1 ? s->value[inst->args[1].value->id] : 0, &value))
+            state = VARYING;
+        break;
+    }
+
+    set_state(s, inst, state, value);
+}
+
+void propagate_constants(struct ir_function *fn)
+{
+    struct sccp s = { fn, NULL, NULL, NULL, { 0 }, { 0 } };
+    struct ir_block *bb;
+    struct ir_inst *inst, *next, *constant, *pos, *cond;
+
+    s.state = calloc(fn->num_insts, sizeof(enum lattice));
+    s.value = calloc(fn->num_insts, sizeof(intptr_t));
+    s.reached = calloc(fn->num_blocks, sizeof(bool));
+
+    s.reached[fn->entry->id] = true;
+    list_push(&s.blocks, fn->entry);
+    while (s.blocks.size || s.insts.size) {
+        if (s.insts.size) {
+            inst = s.insts.data[--s.insts.size];
+            if (s.reached[inst->block->id])
+                visit(&s, inst);
+            continue;
+        }
+        bb = s.blocks.data[--s.blocks.size];
+        for (inst = bb->first; inst; inst = inst->next)
+            visit(&s, inst);
+    }
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        if (!s.reached[bb->id])
+            continue;
+
+        // values known to be constant become constants, after the phi nodes
+        for (pos = bb->first; pos->op == IR_PHI; pos = pos->next);
+        for (inst = bb->first; inst; inst = next) {
+            next = inst->next;
+            if (inst->op == IR_CONST || s.state[inst->id] != CONSTANT)
+                continue;
+            constant = ir_new_inst(fn, IR_CONST);
+            constant->imm = s.value[inst->id];
+            ir_insert_before(inst->op == IR_PHI ? pos : inst, constant);
+            ir_replace_uses(inst, constant);
+            ir_remove(inst);
+        }
+
+        // branches known to go one way jump there
+        inst = bb->last;
+        if (inst->op != IR_BR && inst->op != IR_SWITCH)
+            continue;
+        cond = inst->args[0].value;
+        if (cond->op == IR_CONST)
+            ir_make_jmp(fn, bb, taken_edge(inst, cond->imm));
+    }
+
+    list_free(&s.blocks);
+    list_free(&s.insts);
+    free(s.state);
+    free(s.value);
+    free(s.reached);
+}
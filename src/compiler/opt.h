@@ -0,0 +1,51 @@
+#ifndef BCAUSE_OPT_H
+#define BCAUSE_OPT_H
+
+#include "ir.h"
+
+struct inliner;
+
+//
+// Run the passes of optimization level `level` over a function, inlining
+// the functions `inl` keeps at level 2 and above if it is not NULL.
+//
+void optimize(struct ir_function *fn, unsigned char level, const struct inliner *inl);
+
+//
+// Remove unreachable blocks, merge straight-line sequences of blocks and
+// bypass blocks that only jump elsewhere.
+//
+void simplify_cfg(struct ir_function *fn);
+
+//
+// Turn calls of a function to itself whose value it returns right away
+// into jumps back to its start, storing the arguments to their slots.
+// This must run before the slots are promoted.
+//
+void eliminate_tail_recursion(struct ir_function *fn);
+
+//
+// Turn the stack slots whose addresses are only loaded from and stored to
+// into SSA values, inserting phi nodes where control flow joins.
+//
+void promote_slots(struct ir_function *fn);
+
+//
+// Move the test of loops that test at the top to the bottom, keeping a copy
+// at the top that guards the first entry.
+//
+void rotate_loops(struct ir_function *fn);
+
+//
+// Replace the values that are constant whenever they are computed with
+// constants, and branches whose way is known with jumps, following only
+// the paths that can be taken (sparse conditional constant propagation).
+//
+void propagate_constants(struct ir_function *fn);
+
+//
+// Remove instructions whose values are never used and that have no side effects.
+//
+void eliminate_dead_code(struct ir_function *fn);
+
+#endif /* BCAUSE_OPT_H */
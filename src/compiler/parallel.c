@@ -0,0 +1,415 @@
+#include "parallel.h"
+#include "arena.h"
+#include "inline.h"
+#include "lexer.h"
+#include "list.h"
+#include "parser.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+// Files smaller than this are not worth starting threads for.
+#ifndef PARALLEL_MIN_SIZE
+    #define PARALLEL_MIN_SIZE (32 * 1024)
+#endif
+
+// Smallest chunk a file is cut into.
+#ifndef PARALLEL_MIN_CHUNK
+    #define PARALLEL_MIN_CHUNK (8 * 1024)
+#endif
+
+// Chunks per thread, so that threads finishing early can pick up more work.
+#define CHUNKS_PER_JOB 4
+
+struct parallel;
+
+struct chunk {
+    struct parallel *par;
+    size_t index; /* position of the chunk in the file */
+    size_t begin, end; /* byte range of the chunk */
+
+    struct compiler_args *args;
+    struct compiler_ctx ctx; /* private names, strings and position */
+    struct lexer lex;
+    struct list defs; /* parsed definitions in source order */
+    struct codegen_ids ids; /* numbering of the chunk's first label and string */
+    size_t *string_labels; /* label numbers of the chunk's strings in the merged string table */
+
+    bool parsed; /* the chunk has been parsed (or given up) */
+    bool misaligned; /* parsing did not stop exactly at `end` */
+
+    char *code; /* generated assembly */
+    size_t code_len;
+};
+
+struct parallel {
+    struct chunk *chunks;
+    size_t num_chunks;
+    size_t next; /* next chunk to hand out to a worker */
+    void (*work)(struct chunk *chunk);
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t num_parsed; /* chunks [0, num_parsed) are all parsed */
+    size_t first_misaligned; /* index of the first misaligned chunk, or num_chunks */
+    size_t first_error; /* index of the chunk whose error was reported, or num_chunks */
+    const struct inliner *inl; /* functions to inline, or NULL */
+};
+
+//
+// Skip the rest of a comment; `p` points past the opening `/*`.
+//
+static const char *skip_comment(const char *p, const char *end)
+{
+    while ((p = scan_comment(p, end)) < end) {
+        if (++p < end && *p == '/')
+            return p + 1;
+    }
+    return end;
+}
+
+//
+// Skip the rest of a string or character literal; `p` points past the
+// opening quote. `*` escapes the next character.
+//
+static const char *skip_literal(const char *p, const char *end, char quote)
+{
+    for (; p < end; p++) {
+        if (quote == '"')
+            p = scan_string(p, end);
+        if (p >= end)
+            break;
+        if (*p == quote)
+            return p + 1;
+        if (*p == '*')
+            p++;
+    }
+    return end;
+}
+
+//
+// Cut the source into chunks at the start of top level definitions.
+// A definition starts with an identifier following a `;` or `}` at brace
+// depth 0; only `else` can continue a statement there. Braces inside
+// comments and literals do not count. Chunks are at least `min_size`
+// bytes long. bounds[0..n] receive the limits of the n chunks.
+//
+static size_t split(const char *data, size_t size, size_t min_size, size_t max_chunks, size_t *bounds)
+{
+    const char *p = data, *end = data + size, *ident;
+    bool boundary = false;
+    long depth = 0;
+    size_t n = 0;
+
+    bounds[0] = 0;
+    while (p < end && n + 1 < max_chunks) {
+        switch (*p) {
+        case '/':
+            if (p + 1 < end && p[1] == '*') {
+                p = skip_comment(p + 2, end);
+                continue;
+            }
+            break;
+        case '"':
+        case '\'':
+            p = skip_literal(p + 1, end, *p);
+            boundary = false;
+            continue;
+        case '{':
+            depth++;
+            break;
+        case '}':
+            if (--depth < 0)
+                goto done; /* unbalanced, leave the rest in one piece */
+            boundary = depth == 0;
+            p++;
+            continue;
+        case ';':
+            boundary = depth == 0;
+            p++;
+            continue;
+        default:
+            if (isspace((unsigned char) *p)) {
+                p++;
+                continue;
+            }
+            if (isalpha((unsigned char) *p) || *p == '_') {
+                for (ident = p; p < end && (isalnum((unsigned char) *p) || *p == '_'); p++);
+                if (boundary && !(p - ident == 4 && memcmp(ident, "else", 4) == 0)
+                    && (size_t) (ident - data) - bounds[n] >= min_size)
+                    bounds[++n] = ident - data;
+                boundary = false;
+                continue;
+            }
+        }
+        boundary = false;
+        p++;
+    }
+
+done:
+    if (size - bounds[n] < min_size && n > 0)
+        n--; /* merge a short tail into the previous chunk */
+    bounds[++n] = size;
+    return n;
+}
+
+//
+// Record that a chunk is parsed and wake up workers waiting to report errors.
+//
+static void finish_parse(struct chunk *chunk, bool misaligned)
+{
+    struct parallel *par = chunk->par;
+
+    pthread_mutex_lock(&par->lock);
+    chunk->parsed = true;
+    chunk->misaligned = misaligned;
+    if (misaligned && chunk->index < par->first_misaligned)
+        par->first_misaligned = chunk->index;
+    while (par->num_parsed < par->num_chunks && par->chunks[par->num_parsed].parsed)
+        par->num_parsed++;
+    pthread_cond_broadcast(&par->cond);
+    pthread_mutex_unlock(&par->lock);
+}
+
+//
+// Called before a worker reports an error in `chunk`.
+// Return whether the error should be printed.
+//
+bool parallel_error_turn(struct chunk *chunk)
+{
+    struct parallel *par = chunk->par;
+    bool report;
+
+    pthread_mutex_lock(&par->lock);
+    while (par->num_parsed < chunk->index)
+        pthread_cond_wait(&par->cond, &par->lock);
+
+    // After a misaligned chunk, the chunk may not start where a definition
+    // starts and the error might be bogus; the file gets compiled serially
+    // instead. After an error in a previous chunk, this one is not needed.
+    report = par->first_misaligned > chunk->index && par->first_error > chunk->index;
+    if (report)
+        par->first_error = chunk->index;
+    pthread_mutex_unlock(&par->lock);
+    return report;
+}
+
+//
+// Parse the definitions of a chunk.
+//
+static void parse_chunk(struct chunk *chunk)
+{
+    struct compiler_ctx *ctx = &chunk->ctx;
+    const char *data = ctx->pos.src->data;
+    struct definition *def;
+
+    if (setjmp(ctx->error)) {
+        finish_parse(chunk, false);
+        return;
+    }
+
+    ctx->pos.offset = chunk->begin;
+    lexer_init(&chunk->lex, ctx, chunk->args->word_size, data, ctx->pos.src->size);
+
+    while (chunk->lex.tok.kind != TOK_EOF && (size_t) (chunk->lex.tok.text - data) < chunk->end) {
+        def = parse_definition(ctx, &chunk->lex);
+        list_push(&chunk->defs, def);
+    }
+
+    finish_parse(chunk, (size_t) (chunk->lex.tok.text - data) != chunk->end);
+}
+
+//
+// Add the strings of a chunk to the string table of the whole file,
+// and remember which label each of them ends up with.
+//
+static void merge_strings(struct chunk *chunk, struct intern_table *strings, size_t string_base)
+{
+    size_t i, n = chunk->ctx.strings.count;
+    const struct intern_entry **entries = malloc(n * sizeof(struct intern_entry*));
+
+    chunk->string_labels = malloc(n * sizeof(size_t));
+    intern_entries(&chunk->ctx.strings, entries);
+    for (i = 0; i < n; i++)
+        chunk->string_labels[i] = string_base + intern_add(strings, entries[i]->str, entries[i]->len)->index;
+    free(entries);
+}
+
+//
+// Generate assembly for the definitions of a chunk into its own buffer.
+//
+static void generate_chunk(struct chunk *chunk)
+{
+    FILE *out = open_memstream(&chunk->code, &chunk->code_len);
+    size_t i;
+
+    for (i = 0; i < chunk->defs.size; i++)
+        codegen_definition(chunk->args, out, (struct definition*) chunk->defs.data[i], &chunk->ids, chunk->par->inl);
+    fclose(out);
+}
+
+static void *worker(void *arg)
+{
+    struct parallel *par = (struct parallel*) arg;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&par->next, 1, __ATOMIC_RELAXED)) < par->num_chunks)
+        par->work(&par->chunks[i]);
+    return NULL;
+}
+
+//
+// Run `work` on every chunk using up to `jobs` threads.
+// Return the number of threads that could be started.
+//
+static size_t run(struct parallel *par, void (*work)(struct chunk *chunk), size_t jobs)
+{
+    pthread_t *threads;
+    size_t i, started;
+
+    if (jobs > par->num_chunks)
+        jobs = par->num_chunks;
+
+    par->next = 0;
+    par->work = work;
+
+    threads = malloc(jobs * sizeof(pthread_t));
+    for (started = 0; threads && started < jobs; started++)
+        if (pthread_create(&threads[started], NULL, worker, par) != 0)
+            break;
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    return started;
+}
+
+//
+// Release everything a chunk holds.
+//
+static void free_chunk(struct chunk *chunk)
+{
+    intern_free(&chunk->ctx.strings);
+    free(chunk->string_labels);
+    parser_free(&chunk->ctx);
+
+    lexer_free(&chunk->lex);
+    arena_free(&chunk->ctx.arena);
+    list_free(&chunk->defs);
+    free(chunk->code);
+}
+
+//
+// Compile a large source file on `args->jobs` threads.
+//
+int compile_parallel(struct compiler_args *args, struct source *src, FILE *out, struct codegen_ids *ids, size_t *arena_peak)
+{
+    size_t max_chunks = (size_t) args->jobs * CHUNKS_PER_JOB;
+    size_t min_size, i, j, *bounds;
+    struct parallel par;
+    struct chunk *chunk;
+    struct intern_table strings;
+    struct inliner inl;
+    size_t string_base = ids->string_base, peak = 0;
+    int result = -1;
+
+    // the intermediate code is dumped to stderr as it is made, which only
+    // keeps the order of the functions on one thread
+    if (args->jobs <= 1 || src->size < PARALLEL_MIN_SIZE || args->dump_ir)
+        return -1;
+
+    min_size = src->size / max_chunks;
+    if (min_size < PARALLEL_MIN_CHUNK)
+        min_size = PARALLEL_MIN_CHUNK;
+
+    bounds = malloc((max_chunks + 1) * sizeof(size_t));
+    memset(&par, 0, sizeof(struct parallel));
+    memset(&strings, 0, sizeof(struct intern_table));
+    par.num_chunks = split(src->data, src->size, min_size, max_chunks, bounds);
+    if (par.num_chunks < 2) {
+        free(bounds);
+        return -1;
+    }
+
+    par.chunks = calloc(par.num_chunks, sizeof(struct chunk));
+    par.first_misaligned = par.num_chunks;
+    par.first_error = par.num_chunks;
+    pthread_mutex_init(&par.lock, NULL);
+    pthread_cond_init(&par.cond, NULL);
+
+    for (i = 0; i < par.num_chunks; i++) {
+        chunk = &par.chunks[i];
+        chunk->par = &par;
+        chunk->index = i;
+        chunk->begin = bounds[i];
+        chunk->end = bounds[i + 1];
+
+        chunk->args = args;
+        chunk->ctx.pos.src = src;
+        chunk->ctx.chunk = chunk;
+    }
+
+    // parse all chunks
+    if (!run(&par, parse_chunk, args->jobs))
+        goto out;
+    if (par.first_error < par.num_chunks) {
+        result = 1;
+        goto out;
+    }
+    if (par.first_misaligned < par.num_chunks)
+        goto out;
+
+    // number labels and strings as if the file was compiled in one piece
+    for (i = 0; i < par.num_chunks; i++) {
+        chunk = &par.chunks[i];
+        chunk->ids = *ids;
+        for (j = 0; j < chunk->defs.size; j++) {
+            ids->stmt_id += ((struct definition*) chunk->defs.data[j])->fn.num_labels;
+            ids->cond_id += ((struct definition*) chunk->defs.data[j])->fn.num_conds;
+        }
+        merge_strings(chunk, &strings, string_base);
+        chunk->ids.string_labels = chunk->string_labels;
+        peak += chunk->ctx.arena.peak; /* all chunks are kept until the end */
+    }
+    ids->string_base += strings.count;
+    if (peak > *arena_peak)
+        *arena_peak = peak;
+
+    // the bodies to inline are taken in source order, as a single thread would
+    if (inlining(args)) {
+        inliner_init(&inl, args);
+        for (i = 0; i < par.num_chunks; i++) {
+            chunk = &par.chunks[i];
+            for (j = 0; j < chunk->defs.size; j++)
+                if (((struct definition*) chunk->defs.data[j])->kind == DEF_FUNCTION)
+                    inliner_add(&inl, &((struct definition*) chunk->defs.data[j])->fn, &chunk->ids);
+        }
+        par.inl = &inl;
+    }
+
+    // generate code for all chunks and stitch it together in source order
+    if (!run(&par, generate_chunk, args->jobs))
+        worker(&par);
+
+    for (i = 0; i < par.num_chunks; i++)
+        fwrite(par.chunks[i].code, par.chunks[i].code_len, 1, out);
+    codegen_strings(out, &strings, string_base);
+    result = 0;
+    if (par.inl)
+        inliner_free(&inl);
+
+out:
+    for (i = 0; i < par.num_chunks; i++)
+        free_chunk(&par.chunks[i]);
+    intern_free(&strings);
+    pthread_mutex_destroy(&par.lock);
+    pthread_cond_destroy(&par.cond);
+    free(par.chunks);
+    free(bounds);
+    return result;
+}
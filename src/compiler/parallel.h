@@ -0,0 +1,33 @@
+#ifndef BCAUSE_PARALLEL_H
+#define BCAUSE_PARALLEL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "codegen.h"
+#include "compiler.h"
+#include "source.h"
+
+struct chunk;
+
+//
+// Compile a large source file on `args->jobs` threads.
+// The file is cut at top level definitions into chunks that are parsed and
+// code-generated independently; the output is identical to compiling the
+// file in one piece.
+// `*arena_peak` is raised to the memory held by the syntax trees of all chunks.
+// Return 0 on success, 1 if the file has errors, or -1 when the file should
+// be compiled serially (it is too small, cannot be split safely, or its
+// intermediate code is dumped).
+//
+int compile_parallel(struct compiler_args *args, struct source *src, FILE *out, struct codegen_ids *ids, size_t *arena_peak);
+
+//
+// Called before a worker reports an error in `chunk`.
+// Waits until all preceding chunks have been parsed, so that only the first
+// error in source order is reported. Return whether the error in `chunk` is
+// that one.
+//
+bool parallel_error_turn(struct chunk *chunk);
+
+#endif /* BCAUSE_PARALLEL_H */
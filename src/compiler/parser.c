@@ -0,0 +1,807 @@
+#include "parser.h"
+#include "codegen.h"
+#include "list.h"
+#include "symtab.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define ASSERT_TOKEN(ctx, lex, expect, ...) do {    \
+    if (!accept(lex, expect)) {                     \
+        lexer_pos_missing(lex);                     \
+        compile_error(ctx, __VA_ARGS__);            \
+    }} while (0)
+
+static struct node *expression(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn, int level);
+
+//
+// Consume the current token if it is of the given kind.
+//
+static inline bool accept(struct lexer *lex, enum token_kind kind)
+{
+    if (lex->tok.kind != kind)
+        return false;
+    lexer_next(lex);
+    return true;
+}
+
+//
+// Parse one initialization value.
+// It can be:
+//      integer literal
+//      negative integer literal
+//      'char'
+//      "string"
+//      name
+//
+static struct node *ival(struct compiler_ctx *ctx, struct lexer *lex)
+{
+    struct node *node = (struct node*) arena_alloc(&ctx->arena, sizeof(struct node)), *number;
+
+    switch (lex->tok.kind) {
+    case TOK_IDENT:
+        node->kind = NODE_EXTRN;
+        node->name = lex->tok.name;
+        break;
+
+    case TOK_STRING:
+        node->kind = NODE_STRING;
+        node->value = lex->tok.value;
+        break;
+
+    case TOK_MINUS:
+        lexer_next(lex);
+        if (lex->tok.kind != TOK_NUMBER) {
+            compile_error(ctx, "expect number after " QUOTE_FMT("-") " in ival\n");
+        }
+        number = (struct node*) arena_alloc(&ctx->arena, sizeof(struct node));
+        number->kind = NODE_NUMBER;
+        number->value = lex->tok.value;
+        node->kind = NODE_NEG;
+        node->lhs = number;
+        break;
+
+    case TOK_CHAR:
+    case TOK_NUMBER:
+        node->kind = NODE_NUMBER;
+        node->value = lex->tok.value;
+        break;
+
+    case TOK_EOF:
+        compile_error(ctx, "unexpected end of file, expect ival\n");
+
+    default:
+        compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect ival\n", (int) lex->tok.length, lex->tok.text);
+    }
+
+    lexer_next(lex);
+    return node;
+}
+
+//
+// Parse a list of initialization values up to the closing `;`.
+//
+static void ivals(struct compiler_ctx *ctx, struct lexer *lex, struct definition *def)
+{
+    struct node **link = &def->ivals;
+
+    if (accept(lex, TOK_SEMICOLON))
+        return;
+
+    do {
+        *link = ival(ctx, lex);
+        link = &(*link)->next;
+    } while (accept(lex, TOK_COMMA));
+
+    if (!accept(lex, TOK_SEMICOLON)) {
+        lexer_pos_missing(lex);
+        compile_error(ctx, "expect " QUOTE_FMT(";") " at end of declaration\n");
+    }
+}
+
+//
+// Parse the size of a global array.
+// The initialization list is parsed by ivals().
+//
+static void vector(struct compiler_ctx *ctx, struct lexer *lex, struct definition *def)
+{
+    if (!accept(lex, TOK_RBRACKET)) {
+        if (lex->tok.kind == TOK_EOF) {
+            compile_error(ctx, "unexpected end of file, expect vector size after " QUOTE_FMT("[") "\n");
+        }
+        if (lex->tok.kind == TOK_NUMBER) {
+            def->size = lex->tok.value;
+            lexer_next(lex);
+        }
+
+        if (!accept(lex, TOK_RBRACKET)) {
+            lexer_pos_missing(lex);
+            compile_error(ctx, "expect " QUOTE_FMT("]") " after vector size\n");
+        }
+    }
+}
+
+//
+// Allocate a syntax tree node in the function's arena.
+//
+static struct node *new_node(struct function *fn, enum node_kind kind)
+{
+    struct node *node = (struct node*) arena_alloc(fn->arena, sizeof(struct node));
+    node->kind = kind;
+    return node;
+}
+
+//
+// Parse a postfix operation.
+// Set `is_lvalue` when result is lvalue (address of the value).
+//
+static struct node *postfix(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn, struct node *operand, bool *is_lvalue)
+{
+    struct node *node, **arg;
+    int num_args = 0;
+
+    switch (lex->tok.kind) {
+    case TOK_LBRACKET:
+        /* index operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_INDEX);
+        node->lhs = operand;
+        node->rhs = expression(ctx, lex, fn, 15);
+
+        if (!accept(lex, TOK_RBRACKET)) {
+            compile_error(ctx, "unexpected token " QUOTE_FMT("%.*s") ", expect closing " QUOTE_FMT("]") " after index expression\n", (int) lex->tok.length, lex->tok.text);
+        }
+        *is_lvalue = true;
+        return node;
+
+    case TOK_LPAREN:
+        /* function call */
+        lexer_next(lex);
+        node = new_node(fn, NODE_CALL);
+        node->lhs = operand;
+        arg = &node->rhs;
+
+        while (!accept(lex, TOK_RPAREN)) {
+            *arg = expression(ctx, lex, fn, 15);
+            arg = &(*arg)->next;
+
+            if (++num_args > MAX_FN_CALL_ARGS) {
+                compile_error(ctx, "only %d call arguments are currently supported\n", MAX_FN_CALL_ARGS);
+            }
+
+            if (accept(lex, TOK_RPAREN))
+                break;
+            else if (accept(lex, TOK_COMMA))
+                continue;
+
+            compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect closing " QUOTE_FMT(")") " after call expression\n", (int) lex->tok.length, lex->tok.text);
+        }
+        *is_lvalue = false;
+        return node;
+
+    case TOK_INC:
+        /* postfix increment operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_POST_INC);
+        node->lhs = operand;
+        *is_lvalue = false;
+        return node;
+
+    case TOK_DEC:
+        /* postfix decrement operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_POST_DEC);
+        node->lhs = operand;
+        *is_lvalue = false;
+        return node;
+
+    default:
+        return operand;
+    }
+}
+
+//
+// Parse a term.
+// It may have only unary operations (no binary ops).
+// Set `is_lvalue` when it's an lvalue (address of the value).
+//
+static struct node *term(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn, bool *is_lvalue)
+{
+    struct node *node;
+    const struct symbol *sym;
+    const char *name;
+    size_t offset;
+    bool operand_is_lvalue;
+
+    *is_lvalue = false;
+
+    switch (lex->tok.kind) {
+    case TOK_CHAR: /* character literal */
+    case TOK_NUMBER: /* integer literal */
+        node = new_node(fn, NODE_NUMBER);
+        node->value = lex->tok.value;
+        lexer_next(lex);
+        return node;
+
+    case TOK_STRING: /* string literal */
+        node = new_node(fn, NODE_STRING);
+        node->value = lex->tok.value;
+        lexer_next(lex);
+        return node;
+
+    case TOK_LPAREN: /* parentheses */
+        lexer_next(lex);
+        node = expression(ctx, lex, fn, 15);
+        ASSERT_TOKEN(ctx, lex, TOK_RPAREN, "expect " QUOTE_FMT(")") " after " QUOTE_FMT("(<expr>") "\n");
+        return node;
+
+    case TOK_NOT: /* not operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_NOT);
+        node->lhs = term(ctx, lex, fn, &operand_is_lvalue);
+        return node;
+
+    case TOK_DEC: /* prefix decrement operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_PRE_DEC);
+        node->lhs = term(ctx, lex, fn, &operand_is_lvalue);
+        if (!operand_is_lvalue) {
+            compile_error(ctx, "expected lvalue after " QUOTE_FMT("--") "\n");
+        }
+        *is_lvalue = true;
+        return node;
+
+    case TOK_MINUS: /* negation operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_NEG);
+        node->lhs = term(ctx, lex, fn, &operand_is_lvalue);
+        return node;
+
+    case TOK_INC: /* prefix increment operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_PRE_INC);
+        node->lhs = term(ctx, lex, fn, &operand_is_lvalue);
+        if (!operand_is_lvalue) {
+            compile_error(ctx, "expected lvalue after " QUOTE_FMT("++") "\n");
+        }
+        *is_lvalue = true;
+        return node;
+
+    case TOK_STAR: /* indirection operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_DEREF);
+        node->lhs = term(ctx, lex, fn, &operand_is_lvalue);
+        *is_lvalue = true;
+        return node;
+
+    case TOK_AMP: /* address operator */
+        lexer_next(lex);
+        node = new_node(fn, NODE_ADDR);
+        node->lhs = term(ctx, lex, fn, &operand_is_lvalue);
+        if (!operand_is_lvalue) {
+            compile_error(ctx, "expected lvalue after " QUOTE_FMT("&") "\n");
+        }
+        return node;
+
+    case TOK_IDENT: /* identifier */
+        name = lex->tok.name;
+        offset = ctx->pos.offset;
+        lexer_next(lex);
+
+        if (!(sym = symtab_find(&ctx->symbols, name))) {
+            // Unknown identifier.
+            if (lex->tok.kind != TOK_LPAREN) {
+                ctx->pos.offset = offset;
+                compile_error(ctx, "undefined identifier " QUOTE_FMT("%s") "\n", name);
+            }
+            // When next symbol is '(', add this name to the externals.
+            symtab_insert(&ctx->symbols, name, 0, true);
+            sym = symtab_find(&ctx->symbols, name);
+        }
+
+        if (sym->is_extrn) {
+            node = new_node(fn, NODE_EXTRN);
+            node->name = name;
+        } else {
+            node = new_node(fn, NODE_LOCAL);
+            node->value = sym->offset;
+        }
+
+        *is_lvalue = true;
+        return postfix(ctx, lex, fn, node, is_lvalue);
+
+    case TOK_EOF:
+        compile_error(ctx, "unexpected end of file, expect expression\n");
+
+    default:
+        compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect expression\n", (int) lex->tok.length, lex->tok.text);
+    }
+}
+
+//
+// Binary operators, indexed by token.
+// `level` is the lowest expression level at which the operator is parsed;
+// its right operand is parsed at `level - 1`, making it left associative.
+//
+static const struct binary_operator_info {
+    int level;
+    bool is_cmp;
+    int op; /* enum binary_operator or enum cmp_operator */
+} binary_operators[TOK_COUNT] = {
+    [TOK_STAR]    = { 3,  false, BIN_MUL },
+    [TOK_SLASH]   = { 3,  false, BIN_DIV },
+    [TOK_PERCENT] = { 3,  false, BIN_MOD },
+    [TOK_PLUS]    = { 4,  false, BIN_ADD },
+    [TOK_MINUS]   = { 4,  false, BIN_SUB },
+    [TOK_SHL]     = { 5,  false, BIN_SHL },
+    [TOK_SHR]     = { 5,  false, BIN_SAR },
+    [TOK_LT]      = { 6,  true,  CMP_LT  },
+    [TOK_LE]      = { 6,  true,  CMP_LE  },
+    [TOK_GT]      = { 6,  true,  CMP_GT  },
+    [TOK_GE]      = { 6,  true,  CMP_GE  },
+    [TOK_EQ]      = { 7,  true,  CMP_EQ  },
+    [TOK_NE]      = { 7,  true,  CMP_NE  },
+    [TOK_AMP]     = { 8,  false, BIN_AND },
+    [TOK_PIPE]    = { 10, false, BIN_OR  },
+};
+
+//
+// Assignment operators, indexed by token:
+//      =+  =-  =*  =/  =%  =<<  =>>  =&  =|
+//      =<  =<=  =>  =>=  ===  =!=
+// Plain assignment `=` has no entry.
+//
+static const struct binary_operator_info assign_operators[TOK_COUNT] = {
+    [TOK_ASSIGN_ADD] = { 14, false, BIN_ADD },
+    [TOK_ASSIGN_SUB] = { 14, false, BIN_SUB },
+    [TOK_ASSIGN_MUL] = { 14, false, BIN_MUL },
+    [TOK_ASSIGN_DIV] = { 14, false, BIN_DIV },
+    [TOK_ASSIGN_MOD] = { 14, false, BIN_MOD },
+    [TOK_ASSIGN_SHL] = { 14, false, BIN_SHL },
+    [TOK_ASSIGN_SHR] = { 14, false, BIN_SAR },
+    [TOK_ASSIGN_AND] = { 14, false, BIN_AND },
+    [TOK_ASSIGN_OR]  = { 14, false, BIN_OR  },
+    [TOK_ASSIGN_LT]  = { 14, true,  CMP_LT  },
+    [TOK_ASSIGN_LE]  = { 14, true,  CMP_LE  },
+    [TOK_ASSIGN_GT]  = { 14, true,  CMP_GT  },
+    [TOK_ASSIGN_GE]  = { 14, true,  CMP_GE  },
+    [TOK_ASSIGN_EQ]  = { 14, true,  CMP_EQ  },
+    [TOK_ASSIGN_NE]  = { 14, true,  CMP_NE  },
+};
+
+static inline bool is_assignment(enum token_kind kind)
+{
+    return kind >= TOK_ASSIGN && kind <= TOK_ASSIGN_NE;
+}
+
+//
+// Parse expression.
+// Allow operations up to the given precedence level.
+//
+static struct node *expression(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn, int level)
+{
+    bool left_is_lvalue;
+    struct node *left = term(ctx, lex, fn, &left_is_lvalue), *node;
+    const struct binary_operator_info *info;
+    enum token_kind kind;
+
+    for (;;) {
+        kind = lex->tok.kind;
+
+        if (level >= 13 && kind == TOK_QUESTION) {
+            /* ternary operators have the lowest precedence, so they need to be resolved here */
+            lexer_next(lex);
+            node = new_node(fn, NODE_COND);
+            fn->num_conds++;
+            node->cond = left;
+            node->lhs = expression(ctx, lex, fn, 12);
+            if (!accept(lex, TOK_COLON)) {
+                compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect " QUOTE_FMT(":") " between conditional branches\n", (int) lex->tok.length, lex->tok.text);
+            }
+            node->rhs = expression(ctx, lex, fn, 13);
+            return node;
+        }
+
+        //
+        // Binary operations, left assosiative.
+        //
+        info = &binary_operators[kind];
+        if (info->level && level >= info->level) {
+            lexer_next(lex);
+            node = new_node(fn, info->is_cmp ? NODE_CMP : NODE_BINARY);
+            node->op = info->op;
+            node->lhs = left;
+            node->rhs = expression(ctx, lex, fn, info->level - 1);
+            left = node;
+            left_is_lvalue = false;
+            continue;
+        }
+
+        if (level >= 14 && is_assignment(kind)) {
+            //
+            // Assignment operator, right associative.
+            //
+            if (!left_is_lvalue) {
+                compile_error(ctx, "left operand of assignment has to be an lvalue\n");
+            }
+            lexer_next(lex);
+
+            info = &assign_operators[kind];
+            node = new_node(fn, !info->level ? NODE_ASSIGN : info->is_cmp ? NODE_ASSIGN_CMP : NODE_ASSIGN_BINARY);
+            node->op = info->op;
+            node->lhs = left;
+            node->rhs = expression(ctx, lex, fn, 14);
+            left = node;
+            left_is_lvalue = false;
+            continue;
+        }
+
+        // No more operations at this level.
+        return left;
+    }
+}
+
+//
+// Parse a statement.
+// `in_switch` tells whether `case` labels are allowed here.
+//
+static struct node *statement(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn, bool in_switch)
+{
+    struct node *node, **link;
+    intptr_t value = 0;
+    const char *name;
+
+    switch (lex->tok.kind) {
+    case TOK_LBRACE: {
+        unsigned long stack_offset = ctx->stack_offset;
+        size_t scope = symtab_mark(&ctx->symbols);
+        size_t block_start = ctx->pos.offset;
+
+        node = new_node(fn, NODE_BLOCK);
+        link = &node->lhs;
+
+        lexer_next(lex);
+        while (!accept(lex, TOK_RBRACE)) {
+            if (lex->tok.kind == TOK_EOF) {
+                ctx->pos.offset = block_start;
+                compile_error(ctx, "unexpected end of file, expect " QUOTE_FMT("}") "\n");
+            }
+            *link = statement(ctx, lex, fn, in_switch);
+            link = &(*link)->next;
+        }
+
+        // names and variables of the block are released at its end
+        symtab_rollback(&ctx->symbols, scope);
+        ctx->stack_offset = stack_offset;
+        return node;
+        }
+
+    case TOK_SEMICOLON:
+        lexer_next(lex);
+        return new_node(fn, NODE_NULL); /* null statement */
+
+    case TOK_GOTO: /* goto statement */
+        lexer_next(lex);
+        if (lex->tok.kind != TOK_IDENT) {
+            compile_error(ctx, "expect label name after " QUOTE_FMT("goto") "\n");
+        }
+        node = new_node(fn, NODE_GOTO);
+        node->name = lex->tok.name;
+        node->value = ctx->pos.offset; /* for errors, until the label is resolved */
+        list_push(&ctx->gotos, node);
+        lexer_next(lex);
+        ASSERT_TOKEN(ctx, lex, TOK_SEMICOLON, "expect " QUOTE_FMT(";") " after " QUOTE_FMT("goto") " statement\n");
+        return node;
+
+    case TOK_RETURN: /* return statement */
+        lexer_next(lex);
+        node = new_node(fn, NODE_RETURN);
+        if (!accept(lex, TOK_SEMICOLON)) {
+            if (!accept(lex, TOK_LPAREN)) {
+                lexer_pos_missing(lex);
+                compile_error(ctx, "expect " QUOTE_FMT("(") " or " QUOTE_FMT(";") " after " QUOTE_FMT("return") "\n");
+            }
+            node->lhs = expression(ctx, lex, fn, 15);
+            ASSERT_TOKEN(ctx, lex, TOK_RPAREN, "expect " QUOTE_FMT(")") " after " QUOTE_FMT("return") " statement\n");
+            ASSERT_TOKEN(ctx, lex, TOK_SEMICOLON, "expect " QUOTE_FMT(";") " after " QUOTE_FMT("return") " statement\n");
+        }
+        return node;
+
+    case TOK_IF: /* conditional statement */
+        lexer_next(lex);
+        node = new_node(fn, NODE_IF);
+        fn->num_labels++;
+        ASSERT_TOKEN(ctx, lex, TOK_LPAREN, "expect " QUOTE_FMT("(") " after " QUOTE_FMT("if") "\n");
+        node->cond = expression(ctx, lex, fn, 15);
+        ASSERT_TOKEN(ctx, lex, TOK_RPAREN, "expect " QUOTE_FMT(")") " after condition\n");
+
+        node->lhs = statement(ctx, lex, fn, false);
+        if (accept(lex, TOK_ELSE))
+            node->rhs = statement(ctx, lex, fn, false);
+        return node;
+
+    case TOK_WHILE: /* while statement */
+        lexer_next(lex);
+        node = new_node(fn, NODE_WHILE);
+        fn->num_labels++;
+        ASSERT_TOKEN(ctx, lex, TOK_LPAREN, "expect " QUOTE_FMT("(") " after " QUOTE_FMT("while") "\n");
+        node->cond = expression(ctx, lex, fn, 15);
+        ASSERT_TOKEN(ctx, lex, TOK_RPAREN, "expect " QUOTE_FMT(")") " after condition\n");
+
+        node->lhs = statement(ctx, lex, fn, false);
+        return node;
+
+    case TOK_SWITCH: /* switch statement */
+        lexer_next(lex);
+        node = new_node(fn, NODE_SWITCH);
+        fn->num_labels++;
+        node->cond = expression(ctx, lex, fn, 15);
+        node->lhs = statement(ctx, lex, fn, true);
+        return node;
+
+    case TOK_CASE: /* case statement */
+        if (!in_switch) {
+            compile_error(ctx, "unexpected " QUOTE_FMT("case") " outside of " QUOTE_FMT("switch") " statements\n");
+        }
+
+        lexer_next(lex);
+        switch (lex->tok.kind) {
+        case TOK_CHAR:
+        case TOK_NUMBER:
+            value = lex->tok.value;
+            break;
+        case TOK_EOF:
+            compile_error(ctx, "unexpected end of file, expect constant after " QUOTE_FMT("case") "\n");
+        default:
+            compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect constant after " QUOTE_FMT("case") "\n", (int) lex->tok.length, lex->tok.text);
+        }
+        lexer_next(lex);
+
+        ASSERT_TOKEN(ctx, lex, TOK_COLON, "expect " QUOTE_FMT(":") " after " QUOTE_FMT("case") "\n");
+
+        node = new_node(fn, NODE_CASE);
+        fn->num_labels++;
+        node->value = value;
+        node->lhs = statement(ctx, lex, fn, in_switch);
+        return node;
+
+    case TOK_EXTRN: /* external declaration */
+        lexer_next(lex);
+        do {
+            if (lex->tok.kind != TOK_IDENT) {
+                compile_error(ctx, "expect identifier after " QUOTE_FMT("extrn") "\n");
+            }
+
+            if (symtab_find(&ctx->symbols, lex->tok.name)) {
+                compile_error(ctx, "identifier " QUOTE_FMT("%s") " is already defined in this scope\n", lex->tok.name);
+            }
+
+            symtab_insert(&ctx->symbols, lex->tok.name, 0, true);
+            lexer_next(lex);
+        } while (accept(lex, TOK_COMMA));
+
+        if (!accept(lex, TOK_SEMICOLON)) {
+            lexer_pos_missing(lex);
+            compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect " QUOTE_FMT(";") " or " QUOTE_FMT(",") "\n", (int) lex->tok.length, lex->tok.text);
+        }
+        return new_node(fn, NODE_NULL);
+
+    case TOK_AUTO: /* local declaration */
+        lexer_next(lex);
+        node = new_node(fn, NODE_AUTO);
+        link = &node->lhs;
+        do {
+            if (lex->tok.kind != TOK_IDENT) {
+                compile_error(ctx, "expect identifier after " QUOTE_FMT("auto") "\n");
+            }
+            if (symtab_find(&ctx->symbols, lex->tok.name)) {
+                compile_error(ctx, "identifier " QUOTE_FMT("%s") " is already defined in this scope\n", lex->tok.name);
+            }
+            name = lex->tok.name;
+            lexer_next(lex);
+
+            value = -1;
+            if (lex->tok.kind == TOK_CHAR || lex->tok.kind == TOK_NUMBER) {
+                value = lex->tok.value;
+                lexer_next(lex);
+            }
+            else if (accept(lex, TOK_LBRACKET)) {
+                value = 0;
+                if (lex->tok.kind == TOK_NUMBER) {
+                    value = lex->tok.value;
+                    lexer_next(lex);
+                }
+                if (!accept(lex, TOK_RBRACKET)) {
+                    compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect " QUOTE_FMT("]") "\n", (int) lex->tok.length, lex->tok.text);
+                }
+            }
+
+            if (value < 0) {
+                // Scalar.
+                symtab_insert(&ctx->symbols, name, ctx->stack_offset, false);
+                ctx->stack_offset += 1;
+            } else {
+                // Vector.
+                symtab_insert(&ctx->symbols, name, ctx->stack_offset + value, false);
+                ctx->stack_offset += value + 1;
+            }
+
+            *link = new_node(fn, NODE_VAR);
+            (*link)->value = value;
+            link = &(*link)->next;
+        } while (accept(lex, TOK_COMMA));
+
+        if (!accept(lex, TOK_SEMICOLON)) {
+            lexer_pos_missing(lex);
+            compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect " QUOTE_FMT(";") " or " QUOTE_FMT(",") "\n", (int) lex->tok.length, lex->tok.text);
+        }
+
+        // align stack to 16 bytes
+        if (ctx->stack_offset % 2)
+            ctx->stack_offset++;
+        if (ctx->stack_offset > fn->num_slots)
+            fn->num_slots = ctx->stack_offset;
+        return node;
+
+    case TOK_IDENT:
+        if (lexer_peek(lex)->kind == TOK_COLON) { /* label */
+            node = new_node(fn, NODE_LABEL);
+            node->name = lex->tok.name;
+            if (symtab_find(&ctx->labels, node->name)) {
+                compile_error(ctx, "label " QUOTE_FMT("%s") " is already defined\n", node->name);
+            }
+            node->value = fn->num_named_labels++;
+            symtab_insert(&ctx->labels, node->name, node->value, false);
+            lexer_next(lex);
+            lexer_next(lex);
+            node->lhs = statement(ctx, lex, fn, in_switch);
+            return node;
+        }
+        /* fallthrough */
+
+    default:
+        if (lex->tok.kind == TOK_EOF) {
+            compile_error(ctx, "unexpected end of file, expect statement\n");
+        }
+
+        node = expression(ctx, lex, fn, 15);
+        if (!accept(lex, TOK_SEMICOLON)) {
+            lexer_pos_missing(lex);
+            compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect " QUOTE_FMT(";") " after expression statement\n", (int) lex->tok.length, lex->tok.text);
+        }
+        return node;
+    }
+}
+
+//
+// Parse a list of function arguments.
+//
+static void arguments(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn)
+{
+    while (1) {
+        if (lex->tok.kind != TOK_IDENT) {
+            compile_error(ctx, "expect " QUOTE_FMT(")") " or identifier after function arguments\n");
+        }
+        if (fn->num_args == MAX_FN_CALL_ARGS) {
+            compile_error(ctx, "only %d function arguments are currently supported\n", MAX_FN_CALL_ARGS);
+        }
+
+        if (symtab_find(&ctx->symbols, lex->tok.name)) {
+            compile_error(ctx, "identifier " QUOTE_FMT("%s") " is already defined in this scope\n", lex->tok.name);
+        }
+
+        symtab_insert(&ctx->symbols, lex->tok.name, ctx->stack_offset++, false);
+        fn->num_slots = ++fn->num_args;
+        lexer_next(lex);
+
+        if (accept(lex, TOK_RPAREN))
+            return;
+        if (accept(lex, TOK_COMMA))
+            continue;
+
+        compile_error(ctx, "unexpected " QUOTE_FMT("%.*s") ", expect " QUOTE_FMT(")") " or " QUOTE_FMT(",") "\n", (int) lex->tok.length, lex->tok.text);
+    }
+}
+
+//
+// Point every goto statement of a function at its label.
+//
+static void resolve_gotos(struct compiler_ctx *ctx)
+{
+    const struct symbol *sym;
+    struct node *node;
+    size_t i;
+
+    for (i = 0; i < ctx->gotos.size; i++) {
+        node = (struct node*) ctx->gotos.data[i];
+        if (!(sym = symtab_find(&ctx->labels, node->name))) {
+            ctx->pos.offset = node->value;
+            compile_error(ctx, "undefined label " QUOTE_FMT("%s") "\n", node->name);
+        }
+        node->value = sym->offset;
+    }
+}
+
+//
+// Parse a function definition.
+//
+static void function(struct compiler_ctx *ctx, struct lexer *lex, struct function *fn)
+{
+    // Forget the names of the previous function.
+    symtab_clear(&ctx->symbols);
+    symtab_clear(&ctx->labels);
+    ctx->gotos.size = 0;
+    ctx->stack_offset = 0;
+
+    // Add name of the function to externals.
+    symtab_insert(&ctx->symbols, fn->name, 0, true);
+
+    if (!accept(lex, TOK_RPAREN))
+        arguments(ctx, lex, fn);
+
+    fn->body = statement(ctx, lex, fn, false);
+    resolve_gotos(ctx);
+}
+
+//
+// Parse the next top level definition:
+//      name(...    -- function definition
+//      name[...    -- vector declaration
+//      name...     -- scalar declaration
+// Return NULL at the end of the input.
+//
+struct definition *parse_definition(struct compiler_ctx *ctx, struct lexer *lex)
+{
+    struct definition *def;
+
+    if (lex->tok.kind == TOK_EOF)
+        return NULL;
+
+    if (lex->tok.kind != TOK_IDENT) {
+        compile_error(ctx, "expect identifier at top level\n");
+    }
+
+    def = (struct definition*) arena_alloc(&ctx->arena, sizeof(struct definition));
+    def->name = lex->tok.name;
+    lexer_next(lex);
+
+    switch (lex->tok.kind) {
+    case TOK_LPAREN:
+        lexer_next(lex);
+        def->kind = DEF_FUNCTION;
+        def->fn.name = def->name;
+        def->fn.arena = &ctx->arena;
+        function(ctx, lex, &def->fn);
+        break;
+
+    case TOK_LBRACKET:
+        lexer_next(lex);
+        def->kind = DEF_VECTOR;
+        vector(ctx, lex, def);
+        ivals(ctx, lex, def);
+        break;
+
+    case TOK_EOF:
+        compile_error(ctx, "unexpected end of file after declaration\n");
+
+    default:
+        def->kind = DEF_SCALAR;
+        ivals(ctx, lex, def);
+    }
+
+    return def;
+}
+
+//
+// Release the bookkeeping of local and external names.
+//
+void parser_free(struct compiler_ctx *ctx)
+{
+    symtab_free(&ctx->symbols);
+    symtab_free(&ctx->labels);
+    list_free(&ctx->gotos);
+    ctx->stack_offset = 0;
+}
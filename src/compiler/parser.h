@@ -0,0 +1,21 @@
+#ifndef BCAUSE_PARSER_H
+#define BCAUSE_PARSER_H
+
+#include "arena.h"
+#include "ast.h"
+#include "compiler.h"
+#include "lexer.h"
+
+//
+// Parse the next top level definition.
+// All of its nodes are allocated in `ctx->arena`.
+// Return NULL at the end of the input.
+//
+struct definition *parse_definition(struct compiler_ctx *ctx, struct lexer *lex);
+
+//
+// Release the bookkeeping of local and external names.
+//
+void parser_free(struct compiler_ctx *ctx);
+
+#endif /* BCAUSE_PARSER_H */
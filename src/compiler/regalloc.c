@@ -0,0 +1,300 @@
+#include "regalloc.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Liveness is kept in bit sets over the kept values for every block; past
+// this many bits, functions keep all their values on the stack instead.
+//
+#define MAX_LIVENESS_BITS (1ul << 27)
+
+struct interval {
+    unsigned start, end; /* first and last position the value is live at */
+    unsigned value; /* id of the value */
+};
+
+static int compare_starts(const void *a, const void *b)
+{
+    const struct interval *x = a, *y = b;
+
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return x->value < y->value ? -1 : x->value > y->value;
+}
+
+static inline void set_bit(uint64_t *set, unsigned i)
+{
+    set[i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+static inline bool test_bit(const uint64_t *set, unsigned i)
+{
+    return set[i / 64] >> (i % 64) & 1;
+}
+
+//
+// Tell whether register `r` is assigned to one of the active intervals.
+//
+static bool is_taken(struct interval *const *active, unsigned num_active, const int *reg, int r)
+{
+    unsigned j;
+
+    for (j = 0; j < num_active; j++)
+        if (reg[active[j]->value] == r)
+            return true;
+    return false;
+}
+
+//
+// Tell whether register `r` is overwritten while the value of `interval`,
+// defined at `def`, is live. `next` gives the first position at or after
+// each position whose instruction overwrites a register, which `clobber_at`
+// gives.
+//
+static bool is_clobbered(const struct interval *interval, unsigned def, const int *clobber_at,
+                         const unsigned *next, int r)
+{
+    unsigned p;
+
+    for (p = next[interval->start]; p < interval->end; p = next[p + 1])
+        if (clobber_at[p] == r && p != def)
+            return true;
+    return false;
+}
+
+//
+// Tell whether the value of `a` should rather go to the stack than that of
+// `b`: it is used in fewer nested loops, or in as many but live longer.
+//
+static inline bool is_colder(const struct interval *a, const struct interval *b, const unsigned *loops)
+{
+    if (loops[a->value] != loops[b->value])
+        return loops[a->value] < loops[b->value];
+    return a->end > b->end;
+}
+
+void linear_scan(const struct ir_function *fn, const bool *kept, struct ir_inst *const *root,
+                 const int *hint, const int *clobber, unsigned num_regs, int *reg)
+{
+    unsigned *pos = malloc(fn->num_insts * sizeof(unsigned));
+    int *clobber_at = malloc(fn->num_insts * sizeof(int));
+    unsigned *next = malloc((fn->num_insts + 1) * sizeof(unsigned));
+    unsigned *start = malloc(fn->num_blocks * sizeof(unsigned));
+    unsigned *end = malloc(fn->num_blocks * sizeof(unsigned));
+    int *index = malloc(fn->num_insts * sizeof(int));
+    int *partner = malloc(fn->num_insts * sizeof(int));
+    unsigned *loops = calloc(fn->num_insts, sizeof(unsigned));
+    int *depth;
+    struct interval *intervals, **active;
+    uint64_t *gen, *def, *live_in, *live_out, word;
+    const struct ir_block *bb, *succ;
+    const struct ir_inst *inst, *phi, *value;
+    unsigned i, j, k, n = 0, num_active = 0, words, p = 0, coldest, defined;
+    bool changed;
+    int r;
+    size_t b;
+
+    for (i = 0; i < fn->num_insts; i++) {
+        index[i] = -1;
+        reg[i] = -1;
+        partner[i] = -1;
+    }
+
+    // positions in the layout, and dense numbers for the kept values
+    for (bb = fn->entry; bb; bb = bb->next) {
+        start[bb->id] = p;
+        for (inst = bb->first; inst; inst = inst->next) {
+            clobber_at[p] = clobber[inst->id];
+            pos[inst->id] = p++;
+            if (kept[inst->id])
+                index[inst->id] = n++;
+        }
+        end[bb->id] = p - 1;
+    }
+    for (next[p] = UINT_MAX; p-- > 0;)
+        next[p] = clobber_at[p] >= 0 ? p : next[p + 1];
+
+    words = (n + 63) / 64;
+    if (!n || (uintmax_t) words * 64 * fn->num_blocks > MAX_LIVENESS_BITS) {
+        free(pos);
+        free(clobber_at);
+        free(next);
+        free(start);
+        free(end);
+        free(index);
+        free(partner);
+        free(loops);
+        return;
+    }
+
+    // a loop runs from the block a jump goes back to up to that jump; count
+    // the loops around every position
+    depth = calloc(fn->num_insts + 1, sizeof(int));
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (i = 0; i < bb->num_succs; i++) {
+            if (start[bb->succs[i]->id] <= start[bb->id]) {
+                depth[start[bb->succs[i]->id]]++;
+                depth[end[bb->id] + 1]--;
+            }
+        }
+    }
+    for (k = 1; k < fn->num_insts; k++)
+        depth[k] += depth[k - 1];
+
+    intervals = malloc(n * sizeof(struct interval));
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (index[inst->id] >= 0)
+                intervals[index[inst->id]] = (struct interval) { pos[inst->id], pos[inst->id], inst->id };
+
+    // values used before they are defined in a block, and values defined in it
+    gen = calloc(fn->num_blocks * words, sizeof(uint64_t));
+    def = calloc(fn->num_blocks * words, sizeof(uint64_t));
+    live_in = calloc(fn->num_blocks * words, sizeof(uint64_t));
+    live_out = calloc(fn->num_blocks * words, sizeof(uint64_t));
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (index[inst->id] >= 0)
+                set_bit(def + bb->id * words, index[inst->id]);
+            for (i = 0; i < inst->num_args; i++) {
+                value = inst->args[i].value;
+                if (index[value->id] < 0)
+                    continue;
+
+                // phi operands are read at the end of the predecessor
+                k = inst->op == IR_PHI ? end[bb->preds[i]->id] : pos[root[inst->id]->id];
+                if (loops[value->id] < (unsigned) depth[k])
+                    loops[value->id] = depth[k];
+                if (intervals[index[value->id]].end < k)
+                    intervals[index[value->id]].end = k;
+                if (inst->op != IR_PHI && value->block != bb)
+                    set_bit(gen + bb->id * words, index[value->id]);
+            }
+        }
+    }
+
+    // live_out = union of live_in and phi operands of the successors,
+    // live_in = gen | (live_out & ~def), until nothing changes
+    do {
+        changed = false;
+        for (bb = fn->exit; bb; bb = bb->prev) {
+            b = bb->id * words;
+            for (i = 0; i < bb->num_succs; i++) {
+                succ = bb->succs[i];
+                for (k = 0; k < words; k++)
+                    live_out[b + k] |= live_in[succ->id * words + k];
+                ir_foreach_phi(phi, succ)
+                    for (j = 0; j < succ->num_preds; j++)
+                        if (succ->preds[j] == bb && index[phi->args[j].value->id] >= 0)
+                            set_bit(live_out + b, index[phi->args[j].value->id]);
+            }
+            for (k = 0; k < words; k++) {
+                word = gen[b + k] | (live_out[b + k] & ~def[b + k]);
+                if (word != live_in[b + k]) {
+                    live_in[b + k] = word;
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+
+    // an interval spans every block a value is live in
+    for (bb = fn->entry; bb; bb = bb->next) {
+        b = bb->id * words;
+        for (k = 0; k < words; k++) {
+            for (word = live_in[b + k]; word; word &= word - 1) {
+                i = k * 64 + __builtin_ctzll(word);
+                if (intervals[i].start > start[bb->id])
+                    intervals[i].start = start[bb->id];
+            }
+            for (word = live_out[b + k]; word; word &= word - 1) {
+                i = k * 64 + __builtin_ctzll(word);
+                if (intervals[i].end < end[bb->id])
+                    intervals[i].end = end[bb->id];
+            }
+        }
+    }
+
+    // a phi node and its operands are copied into each other; in the same
+    // register, the copy goes away
+    for (bb = fn->entry; bb; bb = bb->next) {
+        ir_foreach_phi(phi, bb) {
+            if (index[phi->id] < 0)
+                continue;
+            for (i = 0; i < phi->num_args; i++) {
+                value = phi->args[i].value;
+                if (index[value->id] < 0)
+                    continue;
+                if (partner[phi->id] < 0)
+                    partner[phi->id] = value->id;
+                if (partner[value->id] < 0)
+                    partner[value->id] = phi->id;
+            }
+        }
+    }
+
+    // partners go to the stack together, or the copies between them would
+    // go through it
+    for (i = 0; i < fn->num_insts; i++)
+        if (partner[i] >= 0 && loops[partner[i]] > loops[i])
+            loops[i] = loops[partner[i]];
+
+    // a value last read where another one is defined may share its register:
+    // the operands are read before the result is written
+    qsort(intervals, n, sizeof(struct interval), compare_starts);
+    active = malloc(num_regs * sizeof(struct interval*));
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < num_active;) {
+            if (active[j]->end <= intervals[i].start)
+                active[j] = active[--num_active];
+            else
+                j++;
+        }
+
+        defined = pos[intervals[i].value];
+        if (num_active < num_regs) {
+            r = hint[intervals[i].value];
+            if ((r < 0 || is_taken(active, num_active, reg, r) || is_clobbered(&intervals[i], defined, clobber_at, next, r))
+                    && partner[intervals[i].value] >= 0)
+                r = reg[partner[intervals[i].value]];
+            if (r < 0 || is_taken(active, num_active, reg, r) || is_clobbered(&intervals[i], defined, clobber_at, next, r))
+                for (r = 0; r < (int) num_regs && (is_taken(active, num_active, reg, r)
+                            || is_clobbered(&intervals[i], defined, clobber_at, next, r)); r++);
+            if (r < (int) num_regs) {
+                reg[intervals[i].value] = r;
+                active[num_active++] = &intervals[i];
+                continue;
+            }
+        }
+
+        // out of registers: the coldest value goes to the stack
+        for (coldest = num_active, j = 0; j < num_active; j++)
+            if (!is_clobbered(&intervals[i], defined, clobber_at, next, reg[active[j]->value])
+                    && (coldest == num_active || is_colder(active[j], active[coldest], loops)))
+                coldest = j;
+        if (coldest < num_active && is_colder(active[coldest], &intervals[i], loops)) {
+            reg[intervals[i].value] = reg[active[coldest]->value];
+            reg[active[coldest]->value] = -1;
+            active[coldest] = &intervals[i];
+        }
+    }
+
+    free(pos);
+    free(clobber_at);
+    free(next);
+    free(start);
+    free(end);
+    free(index);
+    free(partner);
+    free(loops);
+    free(depth);
+    free(intervals);
+    free(active);
+    free(gen);
+    free(def);
+    free(live_in);
+    free(live_out);
+}
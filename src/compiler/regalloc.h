@@ -0,0 +1,23 @@
+#ifndef BCAUSE_REGALLOC_H
+#define BCAUSE_REGALLOC_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+
+//
+// Assign registers 0 to `num_regs` - 1 to the values marked in `kept` by
+// linear scan over the layout of `fn`. Every instruction reads its operands
+// where `root` says it is evaluated, which is the instruction itself for
+// kept values. A value gets the register `hint` gives it, if not -1, when
+// that one is free, or else the one of a phi node it is an operand of, or of
+// an operand of it if it is a phi node. A value live across an instruction
+// does not get the register `clobber` says its code overwrites once it has
+// read its operands, if not -1. When the registers run out, values used in
+// fewer nested loops go to the stack first, and of those the ones live the
+// longest; they get -1 in `reg`.
+//
+void linear_scan(const struct ir_function *fn, const bool *kept, struct ir_inst *const *root,
+                 const int *hint, const int *clobber, unsigned num_regs, int *reg);
+
+#endif /* BCAUSE_REGALLOC_H */
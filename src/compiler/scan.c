@@ -0,0 +1,125 @@
+#include "scan.h"
+
+#include <stdint.h>
+
+#if !defined(BCAUSE_NO_SIMD) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define SCAN_AVX2
+#elif !defined(BCAUSE_NO_SIMD) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define SCAN_SSE2
+#endif
+
+static inline int is_space(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#if defined(SCAN_AVX2)
+
+#define SCAN_WIDTH 32
+typedef __m256i vec_t;
+typedef uint32_t mask_t;
+
+static inline vec_t vec_load(const char *p) { return _mm256_loadu_si256((const vec_t*) p); }
+static inline vec_t vec_splat(char c) { return _mm256_set1_epi8(c); }
+static inline mask_t vec_eq(vec_t a, char c) { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, vec_splat(c))); }
+
+// bytes in '\t'...'\r' or ' '
+static inline mask_t vec_space(vec_t a)
+{
+    vec_t t = _mm256_sub_epi8(a, vec_splat('\t'));
+    vec_t range = _mm256_cmpeq_epi8(_mm256_min_epu8(t, vec_splat('\r' - '\t')), t);
+    return _mm256_movemask_epi8(_mm256_or_si256(range, _mm256_cmpeq_epi8(a, vec_splat(' '))));
+}
+
+#elif defined(SCAN_SSE2)
+
+#define SCAN_WIDTH 16
+typedef __m128i vec_t;
+typedef uint32_t mask_t;
+
+static inline vec_t vec_load(const char *p) { return _mm_loadu_si128((const vec_t*) p); }
+static inline vec_t vec_splat(char c) { return _mm_set1_epi8(c); }
+static inline mask_t vec_eq(vec_t a, char c) { return _mm_movemask_epi8(_mm_cmpeq_epi8(a, vec_splat(c))); }
+
+// bytes in '\t'...'\r' or ' '
+static inline mask_t vec_space(vec_t a)
+{
+    vec_t t = _mm_sub_epi8(a, vec_splat('\t'));
+    vec_t range = _mm_cmpeq_epi8(_mm_min_epu8(t, vec_splat('\r' - '\t')), t);
+    return _mm_movemask_epi8(_mm_or_si128(range, _mm_cmpeq_epi8(a, vec_splat(' '))));
+}
+
+#endif
+
+#ifdef SCAN_WIDTH
+
+#define FULL_MASK ((mask_t) (((uint64_t) 1 << SCAN_WIDTH) - 1))
+
+const char *scan_space(const char *p, const char *end)
+{
+    mask_t stop;
+
+    for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH)
+        if ((stop = ~vec_space(vec_load(p)) & FULL_MASK))
+            return p + __builtin_ctz(stop);
+
+    while (p < end && is_space(*p))
+        p++;
+    return p;
+}
+
+const char *scan_comment(const char *p, const char *end)
+{
+    mask_t stop;
+
+    for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH)
+        if ((stop = vec_eq(vec_load(p), '*')))
+            return p + __builtin_ctz(stop);
+
+    while (p < end && *p != '*')
+        p++;
+    return p;
+}
+
+const char *scan_string(const char *p, const char *end)
+{
+    mask_t stop;
+    vec_t v;
+
+    for (; end - p >= SCAN_WIDTH; p += SCAN_WIDTH) {
+        v = vec_load(p);
+        if ((stop = vec_eq(v, '"') | vec_eq(v, '*')))
+            return p + __builtin_ctz(stop);
+    }
+
+    while (p < end && *p != '"' && *p != '*')
+        p++;
+    return p;
+}
+
+#else /* scalar fallback */
+
+const char *scan_space(const char *p, const char *end)
+{
+    while (p < end && is_space(*p))
+        p++;
+    return p;
+}
+
+const char *scan_comment(const char *p, const char *end)
+{
+    while (p < end && *p != '*')
+        p++;
+    return p;
+}
+
+const char *scan_string(const char *p, const char *end)
+{
+    while (p < end && *p != '"' && *p != '*')
+        p++;
+    return p;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef BCAUSE_SCAN_H
+#define BCAUSE_SCAN_H
+
+#include <stddef.h>
+
+//
+// Bulk scanning kernels used by the lexer.
+// Each one returns a pointer to the first byte in [p, end) that stops the
+// scan, or `end`. Line numbers are not tracked here; they are recovered from
+// byte offsets only when a diagnostic is printed (see source_line()).
+//
+// With SSE2 or AVX2 available at compile time, 16 or 32 bytes are examined
+// at once; define BCAUSE_NO_SIMD to force the scalar versions. All variants
+// return the same results.
+//
+
+// Skip whitespace; stop at the first non-space byte.
+const char *scan_space(const char *p, const char *end);
+
+// Skip comment text; stop at the next '*'.
+const char *scan_comment(const char *p, const char *end);
+
+// Skip string literal text; stop at the next '"' or '*'.
+const char *scan_string(const char *p, const char *end);
+
+#endif /* BCAUSE_SCAN_H */
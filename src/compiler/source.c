@@ -0,0 +1,163 @@
+#include "source.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+// Read a file descriptor until end of file.
+// Used for files that cannot be mapped (pipes, page-sized files).
+//
+static int read_all(struct source *src, int fd, size_t size_hint)
+{
+    size_t alloc = size_hint + 1, size = 0;
+    char *data = malloc(alloc), *grown;
+    ssize_t n;
+
+    if (!data)
+        return -1;
+
+    for (;;) {
+        if (size + 1 >= alloc) {
+            if (!(grown = realloc(data, alloc *= 2))) {
+                free(data);
+                return -1;
+            }
+            data = grown;
+        }
+
+        if ((n = read(fd, data + size, alloc - size - 1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            free(data);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        size += n;
+    }
+
+    data[size] = '\0';
+    src->data = data;
+    src->size = size;
+    src->is_mapped = false;
+    return 0;
+}
+
+//
+// Map or read the whole file into memory.
+// Return 0 on success, -1 with errno set otherwise.
+//
+int source_open(struct source *src, const char *file_name)
+{
+    struct stat st;
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *data;
+    int fd, err;
+
+    src->file_name = file_name;
+    src->lines = NULL;
+    src->num_lines = 0;
+
+    if ((fd = open(file_name, O_RDONLY)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    // The kernel zero-fills the rest of the last mapped page, which gives us
+    // the terminating '\0' for free. Files ending exactly on a page boundary
+    // have no such padding and get read into a buffer instead.
+    if (S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size % page_size != 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            src->data = data;
+            src->size = st.st_size;
+            src->is_mapped = true;
+            close(fd);
+            return 0;
+        }
+    }
+
+    if (read_all(src, fd, S_ISREG(st.st_mode) ? (size_t) st.st_size : BUFSIZ) < 0)
+        goto fail;
+
+    close(fd);
+    return 0;
+
+fail:
+    err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+}
+
+//
+// Record where every line of the source starts.
+//
+static void index_lines(struct source *src)
+{
+    const char *p = src->data, *end = src->data + src->size;
+    size_t n = 1;
+
+    while ((p = memchr(p, '\n', end - p))) {
+        n++;
+        p++;
+    }
+
+    if (!(src->lines = malloc(n * sizeof(size_t)))) {
+        fprintf(stderr, "out of memory in index_lines()\n");
+        exit(1);
+    }
+
+    src->lines[0] = 0;
+    src->num_lines = 1;
+    for (p = src->data; (p = memchr(p, '\n', end - p)); p++)
+        src->lines[src->num_lines++] = p + 1 - src->data;
+}
+
+//
+// Return the 1-based line number of the byte at `offset`.
+// The newline index is built by the first call and reused afterwards.
+//
+size_t source_line(struct source *src, size_t offset)
+{
+    size_t lo = 0, hi, mid;
+
+    if (!src->lines)
+        index_lines(src);
+
+    // find the last line starting at or before `offset`
+    hi = src->num_lines;
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (src->lines[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo + 1;
+}
+
+//
+// Release the contents of a source file.
+//
+void source_close(struct source *src)
+{
+    if (src->is_mapped)
+        munmap((void*) src->data, src->size);
+    else
+        free((void*) src->data);
+
+    free(src->lines);
+
+    src->data = NULL;
+    src->size = 0;
+    src->lines = NULL;
+    src->num_lines = 0;
+}
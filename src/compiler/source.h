@@ -0,0 +1,34 @@
+#ifndef BCAUSE_SOURCE_H
+#define BCAUSE_SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct source {
+    const char *file_name; /* path of the source file */
+    const char *data; /* file contents, always followed by a '\0' byte */
+    size_t size; /* size of the contents in bytes */
+    bool is_mapped; /* was `data` mapped using mmap()? */
+
+    size_t *lines; /* offsets of the first byte of every line, built on first use */
+    size_t num_lines; /* number of entries in `lines` */
+};
+
+//
+// Map or read the whole file into memory.
+// Return 0 on success, -1 with errno set otherwise.
+//
+int source_open(struct source *src, const char *file_name);
+
+//
+// Return the 1-based line number of the byte at `offset`.
+// The newline index is built by the first call and reused afterwards.
+//
+size_t source_line(struct source *src, size_t offset);
+
+//
+// Release the contents of a source file.
+//
+void source_close(struct source *src);
+
+#endif /* BCAUSE_SOURCE_H */
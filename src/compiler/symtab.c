@@ -0,0 +1,113 @@
+#include "symtab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMTAB_INIT_CAPACITY 64
+
+//
+// Scramble the address of an interned name.
+//
+static size_t symtab_hash(const char *name)
+{
+    uint64_t hash = (uintptr_t) name;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+//
+// Tell whether a slot holds a visible name.
+//
+static inline bool symtab_live(const struct symtab *table, const struct symbol *sym)
+{
+    return sym->name && sym->generation == table->generation;
+}
+
+//
+// Return the slot holding `name`, or the empty slot where it belongs.
+//
+static struct symbol *symtab_slot(const struct symtab *table, const char *name)
+{
+    size_t mask = table->capacity - 1, i;
+
+    for (i = symtab_hash(name) & mask; symtab_live(table, &table->slots[i]) && table->slots[i].name != name; i = (i + 1) & mask);
+    return &table->slots[i];
+}
+
+//
+// Double the number of slots and re-insert all symbols.
+// Symbols are re-inserted in their original order; symtab_rollback()
+// relies on no symbol's probe sequence passing a younger one.
+//
+static void symtab_grow(struct symtab *table)
+{
+    struct symbol *old = table->slots;
+    size_t old_capacity = table->capacity, i;
+
+    table->capacity = old_capacity ? old_capacity * 2 : SYMTAB_INIT_CAPACITY;
+    table->slots = calloc(table->capacity, sizeof(struct symbol));
+
+    for (i = 0; i < table->log.size; i++) {
+        const char *name = (const char*) table->log.data[i];
+        size_t mask = old_capacity - 1, j;
+
+        for (j = symtab_hash(name) & mask; old[j].name != name; j = (j + 1) & mask);
+        *symtab_slot(table, name) = old[j];
+    }
+
+    free(old);
+}
+
+const struct symbol *symtab_find(const struct symtab *table, const char *name)
+{
+    struct symbol *sym;
+
+    if (!table->capacity)
+        return NULL;
+    sym = symtab_slot(table, name);
+    return symtab_live(table, sym) ? sym : NULL;
+}
+
+void symtab_insert(struct symtab *table, const char *name, intptr_t offset, bool is_extrn)
+{
+    struct symbol *sym;
+
+    if ((table->log.size + 1) * 2 > table->capacity)
+        symtab_grow(table);
+
+    sym = symtab_slot(table, name);
+    sym->name = name;
+    sym->generation = table->generation;
+    sym->offset = offset;
+    sym->is_extrn = is_extrn;
+    list_push(&table->log, (void*) name);
+}
+
+//
+// Names are removed youngest first. Any older name stopped probing before
+// reaching the slot of a younger one, so slots can simply be emptied.
+//
+void symtab_rollback(struct symtab *table, size_t mark)
+{
+    while (table->log.size > mark)
+        symtab_slot(table, (const char*) table->log.data[--table->log.size])->name = NULL;
+}
+
+//
+// Emptying the slots one by one is left to later insertions.
+//
+void symtab_clear(struct symtab *table)
+{
+    table->log.size = 0;
+    if (++table->generation == 0 && table->slots)
+        memset(table->slots, 0, table->capacity * sizeof(struct symbol));
+}
+
+void symtab_free(struct symtab *table)
+{
+    list_free(&table->log);
+    free(table->slots);
+    memset(table, 0, sizeof(struct symtab));
+}
@@ -0,0 +1,61 @@
+#ifndef BCAUSE_SYMTAB_H
+#define BCAUSE_SYMTAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+
+struct symbol {
+    const char *name; /* interned name, NULL for an empty slot */
+    unsigned generation; /* slots of an older generation are empty too */
+    intptr_t offset; /* stack slot of a local variable, or number of a label */
+    bool is_extrn; /* name of an external variable or function */
+};
+
+//
+// Names visible in the current function.
+// Names are interned by the lexer, so the table hashes and compares their
+// addresses. Every insertion is logged, so that the names declared since a
+// mark can be removed again when a block ends. All names are dropped at
+// once when a function ends by starting a new generation.
+//
+struct symtab {
+    struct symbol *slots; /* open-addressing hash table */
+    size_t capacity; /* number of slots, always a power of two */
+    unsigned generation; /* generation of the live slots */
+    struct list log; /* names in order of insertion */
+};
+
+//
+// Return the symbol with the given name, or NULL if it is not visible.
+//
+const struct symbol *symtab_find(const struct symtab *table, const char *name);
+
+//
+// Add a name that is not visible yet.
+//
+void symtab_insert(struct symtab *table, const char *name, intptr_t offset, bool is_extrn);
+
+//
+// Return a mark for symtab_rollback().
+//
+static inline size_t symtab_mark(const struct symtab *table)
+{
+    return table->log.size;
+}
+
+//
+// Remove all names inserted after `mark`.
+//
+void symtab_rollback(struct symtab *table, size_t mark);
+
+//
+// Remove all names.
+//
+void symtab_clear(struct symtab *table);
+
+void symtab_free(struct symtab *table);
+
+#endif /* BCAUSE_SYMTAB_H */
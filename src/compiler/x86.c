@@ -0,0 +1,1903 @@
+#include "x86.h"
+#include "regalloc.h"
+
+#include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *condition_codes[CMP_NE + 1] = {
+    "l", "le", "g", "ge", "e", "ne"
+};
+
+static const char *inverse_condition_codes[CMP_NE + 1] = {
+    "ge", "g", "le", "l", "ne", "e"
+};
+
+/* the same comparison with the operands the other way round */
+static const enum ir_op swapped_comparisons[CMP_NE + 1] = {
+    IR_GT, IR_GE, IR_LT, IR_LE, IR_EQ, IR_NE
+};
+
+static const char *arith_instructions[IR_OR + 1] = {
+    [IR_ADD] = "add",
+    [IR_SUB] = "sub",
+    [IR_MUL] = "imul",
+    [IR_AND] = "and",
+    [IR_OR] = "or",
+};
+
+//
+// Registers expression trees are evaluated in. %rax, %rcx and %rdx are left
+// out: they are the fixed operands of division and shifts, and serve as
+// temporaries within a single instruction.
+//
+#define NUM_SCRATCH 6
+static const char *scratch_registers[NUM_SCRATCH] = {
+    "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11"
+};
+
+//
+// Callee-saved registers that values live across instructions are kept in.
+//
+#define NUM_ALLOCATABLE 5
+static const char *allocatable_registers[NUM_ALLOCATABLE] = {
+    "%rbx", "%r12", "%r13", "%r14", "%r15"
+};
+
+//
+// Leaf functions call nothing that would clobber the caller-saved registers,
+// so values are kept in the argument registers before any callee-saved one,
+// and the arguments stay where they come in. %rax is the temporary within an
+// instruction instead of %rcx, which shifts borrow; no value is kept in %rdx
+// across a division. Caller-saved registers no value is kept in are added to
+// the scratch ones, and callee-saved ones if deep trees need them.
+//
+#define NUM_LEAF_SCRATCH 2
+static const char *leaf_scratch_registers[NUM_LEAF_SCRATCH] = {
+    "%r10", "%r11"
+};
+
+#define NUM_LEAF_ALLOCATABLE 11
+static const char *leaf_allocatable_registers[NUM_LEAF_ALLOCATABLE] = {
+    "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9", "%rbx", "%r12", "%r13", "%r14", "%r15"
+};
+
+#define NO_LOAD UINT_MAX
+
+//
+// Switches with at most this many cases compare the value with each of them.
+// More cases are looked up in a jump table when they take at least one in
+// SWITCH_DENSITY of its entries, and searched for in halves otherwise.
+//
+#define SWITCH_LINEAR 3
+#define SWITCH_DENSITY 3
+
+struct x86 {
+    struct compiler_args *args;
+    FILE *out;
+    struct ir_function *fn;
+    const struct codegen_ids *ids;
+
+    intptr_t *slots; /* place in the frame of every stack slot still in use */
+    intptr_t *home; /* frame offset of every value kept on the stack, or 0 */
+    const char **reg; /* register of every value kept in one, or NULL */
+    const char **scratch; /* registers expression trees are evaluated in */
+    unsigned num_scratch;
+    const char *temp; /* register for an operand within a single instruction */
+    bool keeps_rcx; /* whether a value is kept in %rcx, which shifts borrow */
+    const char **allocatable; /* registers values are kept in */
+    unsigned num_allocatable;
+    intptr_t saved[NUM_LEAF_ALLOCATABLE]; /* where used callee-saved registers are saved, or 0 */
+    bool frame; /* whether %rbp points to a frame, or the function has none */
+    bool *inlined; /* evaluated as part of the expression tree of its only user */
+    unsigned *need; /* registers the tree of a value needs (Sethi-Ullman number) */
+    bool private_frame; /* no stack slot address escapes, so calls may reuse the frame */
+    bool leaf; /* the function calls nothing */
+    const struct ir_block **target; /* by block, where jumps to it go */
+    const struct ir_block **next; /* by block, the block laid out after it, or NULL */
+    bool *head; /* by block, whether a jump goes back to it */
+};
+
+//
+// Tell whether a value is an inner node of an expression tree, computed
+// where it is used; all other values are leaves.
+//
+static inline bool is_tree(const struct x86 *x, const struct ir_inst *value)
+{
+    return x->inlined[value->id] && value->op != IR_PARAM;
+}
+
+static inline bool fits_imm32(intptr_t value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static inline bool is_imm32(const struct ir_inst *value)
+{
+    return value->op == IR_CONST && fits_imm32(value->imm);
+}
+
+//
+// Tell whether a value is recomputed wherever it is used instead of being
+// kept. So are the addresses of slots and globals plus a constant, which
+// loads and stores use as their displacement.
+//
+static inline bool rematerialized(const struct ir_inst *value)
+{
+    const struct ir_inst *base = value->num_args > 0 ? value->args[0].value : NULL;
+
+    if (value->op == IR_ADD)
+        return (base->op == IR_SLOT || base->op == IR_GLOBAL) && is_imm32(value->args[1].value);
+    return value->op == IR_CONST || value->op == IR_STRING || value->op == IR_GLOBAL || value->op == IR_SLOT;
+}
+
+static inline intptr_t slot_offset(const struct x86 *x, intptr_t slot)
+{
+    return -((slot < 0 ? slot : x->slots[slot]) + 2) * x->args->word_size;
+}
+
+//
+// Registers needed to evaluate a value into a register.
+//
+static inline unsigned need(const struct x86 *x, const struct ir_inst *value)
+{
+    return is_tree(x, value) ? x->need[value->id] : 1;
+}
+
+//
+// Registers needed for an operand that leaves may be used as directly.
+//
+static inline unsigned operand_need(const struct x86 *x, const struct ir_inst *value)
+{
+    return is_tree(x, value) ? x->need[value->id] : 0;
+}
+
+//
+// Registers needed for a value used in a register, which a leaf kept in a
+// register already is.
+//
+static inline unsigned register_need(const struct x86 *x, const struct ir_inst *value)
+{
+    return !is_tree(x, value) && x->reg[value->id] ? 0 : need(x, value);
+}
+
+//
+// Tell whether the second operand of a binary operator is a load that is
+// read from memory by the operator itself.
+//
+static inline bool folded(const struct x86 *x, const struct ir_inst *value)
+{
+    return is_tree(x, value) && value->op == IR_LOAD;
+}
+
+//
+// Registers needed for two operands that need `a` and `b` registers and keep
+// `a_hold` and `b_hold` registers once evaluated: whichever is better of
+// evaluating one of them first and keeping its result during the other one.
+//
+static inline unsigned pair_need(unsigned a, unsigned a_hold, unsigned b, unsigned b_hold)
+{
+    unsigned a_first = a > a_hold + b ? a : a_hold + b;
+    unsigned b_first = b > b_hold + a ? b : b_hold + a;
+
+    if (!a || !b)
+        return a + b;
+    return a_first < b_first ? a_first : b_first;
+}
+
+static void block_label(const struct x86 *x, const struct ir_block *bb)
+{
+    fprintf(x->out, ".L.bb%u.%s", bb->id, x->fn->name);
+}
+
+//
+// Load a leaf into a register.
+//
+static void load(struct x86 *x, const struct ir_inst *value, const char *reg)
+{
+    if (x->reg[value->id]) {
+        if (strcmp(x->reg[value->id], reg))
+            fprintf(x->out, "  mov %s, %s\n", x->reg[value->id], reg);
+        return;
+    }
+    if (x->home[value->id]) {
+        fprintf(x->out, "  mov %ld(%%rbp), %s\n", x->home[value->id], reg);
+        return;
+    }
+
+    switch (value->op) {
+    case IR_CONST:
+        fprintf(x->out, "  mov $%ld, %s\n", value->imm, reg);
+        break;
+    case IR_STRING:
+        fprintf(x->out, "  lea .string.%lu(%%rip), %s\n", string_label(x->ids, value->imm), reg);
+        break;
+    case IR_GLOBAL:
+        fprintf(x->out, "  lea %s(%%rip), %s\n", value->name, reg);
+        break;
+    case IR_SLOT:
+        fprintf(x->out, "  lea %ld(%%rbp), %s\n", slot_offset(x, value->imm), reg);
+        break;
+    case IR_ADD:
+        // a rematerialized address
+        if (value->args[0].value->op == IR_GLOBAL)
+            fprintf(x->out, "  lea %s%+ld(%%rip), %s\n", value->args[0].value->name, value->args[1].value->imm, reg);
+        else if (fits_imm32(slot_offset(x, value->args[0].value->imm) + value->args[1].value->imm))
+            fprintf(x->out, "  lea %ld(%%rbp), %s\n", slot_offset(x, value->args[0].value->imm) + value->args[1].value->imm, reg);
+        else {
+            load(x, value->args[0].value, reg);
+            fprintf(x->out, "  add $%ld, %s\n", value->args[1].value->imm, reg);
+        }
+        break;
+    case IR_PARAM:
+        fprintf(x->out, "  mov %s, %s\n", arg_registers[value->imm], reg);
+        break;
+    default:
+        fprintf(stderr, "x86: value v%u has no location\n", value->id);
+        exit(1);
+    }
+}
+
+//
+// Write the source operand of an instruction reading the leaf `value` into
+// `buf`. Values that are neither kept in registers or on the stack,
+// arguments still in their registers nor small constants are loaded into
+// `reg` first; so are constants if `imm` is false.
+//
+static const char *source(struct x86 *x, const struct ir_inst *value, const char *reg, bool imm, char *buf)
+{
+    if (x->reg[value->id])
+        return x->reg[value->id];
+    if (imm && is_imm32(value))
+        sprintf(buf, "$%ld", value->imm);
+    else if (x->home[value->id])
+        sprintf(buf, "%ld(%%rbp)", x->home[value->id]);
+    else if (value->op == IR_PARAM)
+        return arg_registers[value->imm];
+    else {
+        load(x, value, reg);
+        return reg;
+    }
+    return buf;
+}
+
+//
+// An operand of an instruction: a value, or the memory operand at
+// disp(base, index, scale), relative to a register, %rbp or a global.
+//
+struct operand {
+    const struct ir_inst *value; /* the value, or the base of the address */
+    const struct ir_inst *index; /* index of the address, or NULL */
+    bool memory; /* whether this is a memory operand */
+    bool frame; /* whether the address is relative to %rbp */
+    const char *global; /* symbol the address is relative to, or NULL */
+    intptr_t disp;
+    unsigned scale;
+
+    unsigned need; /* registers needed to evaluate it */
+    unsigned hold; /* registers it keeps once evaluated */
+    const char *reg, *index_reg; /* registers of `value` and `index`, once evaluated */
+};
+
+//
+// Make an operand of a value, which may be NULL for none. Leaves are left
+// alone if `direct`, for source(), and loaded into a register otherwise.
+//
+static void value_operand(const struct x86 *x, struct operand *op, const struct ir_inst *value, bool direct)
+{
+    memset(op, 0, sizeof(struct operand));
+    op->value = value;
+    if (value)
+        op->need = direct ? operand_need(x, value) : need(x, value);
+    op->hold = op->need > 0;
+}
+
+//
+// Make an operand of a value that has to be in a register.
+//
+static void register_operand(const struct x86 *x, struct operand *op, const struct ir_inst *value)
+{
+    memset(op, 0, sizeof(struct operand));
+    op->value = value;
+    if (!value)
+        return;
+    op->need = register_need(x, value);
+    op->hold = op->need > 0;
+    if (!op->need)
+        op->reg = x->reg[value->id];
+}
+
+//
+// Make the memory operand at address `addr`. An added constant becomes the
+// displacement, an added index shifted by up to three the scaled index, and
+// a constant added to that index part of the displacement. Slots and globals
+// are addressed relative to %rbp and %rip.
+//
+static void memory_operand(const struct x86 *x, struct operand *op, const struct ir_inst *addr)
+{
+    const struct ir_inst *base = addr, *offset, *index = NULL, *shift;
+    struct operand b, i;
+    intptr_t disp = 0;
+    unsigned scale = 1;
+
+    if ((is_tree(x, addr) || rematerialized(addr)) && addr->op == IR_ADD) {
+        offset = addr->args[1].value;
+        shift = offset->num_args > 1 ? offset->args[1].value : NULL;
+        if (is_imm32(offset)) {
+            base = addr->args[0].value;
+            disp = offset->imm;
+        }
+        else if (is_tree(x, offset) && offset->op == IR_SHL && shift->op == IR_CONST && shift->imm >= 0 && shift->imm <= 3) {
+            base = addr->args[0].value;
+            index = offset->args[0].value;
+            scale = 1 << shift->imm;
+            if (is_imm32(index) && fits_imm32(index->imm * (intptr_t) scale)) {
+                disp = index->imm * scale;
+                index = NULL;
+            }
+            else if (is_tree(x, index) && (index->op == IR_ADD || index->op == IR_SUB) && is_imm32(index->args[1].value)
+                    && fits_imm32(index->args[1].value->imm * (intptr_t) scale)
+                    && fits_imm32(-index->args[1].value->imm * (intptr_t) scale)) {
+                disp = index->args[1].value->imm * (intptr_t) scale;
+                disp = index->op == IR_SUB ? -disp : disp;
+                index = index->args[0].value;
+            }
+        }
+    }
+
+    if (base->op == IR_SLOT && fits_imm32(disp + slot_offset(x, base->imm))) {
+        register_operand(x, &b, NULL);
+        b.frame = true;
+        disp += slot_offset(x, base->imm);
+    }
+    else if (base->op == IR_GLOBAL && !index) {
+        register_operand(x, &b, NULL);
+        b.global = base->name;
+    }
+    else
+        register_operand(x, &b, base);
+    register_operand(x, &i, index);
+
+    *op = b;
+    op->memory = true;
+    op->index = index;
+    op->index_reg = i.reg;
+    op->disp = disp;
+    op->scale = scale;
+    op->need = pair_need(b.need, b.hold, i.need, i.hold);
+    op->hold = b.hold + i.hold;
+}
+
+//
+// Write a memory operand, or the register of an evaluated value, into `buf`.
+//
+static const char *format(const struct x86 *x, const struct operand *op, char *buf)
+{
+    int n = 0;
+
+    (void) x;
+    if (!op->memory)
+        return op->reg;
+
+    if (op->global)
+        sprintf(buf, op->disp ? "%s%+ld(%%rip)" : "%s(%%rip)", op->global, op->disp);
+    else {
+        if (op->disp)
+            n = sprintf(buf, "%ld", op->disp);
+        if (op->index_reg)
+            sprintf(buf + n, "(%s,%s,%u)", op->frame ? "%rbp" : op->reg, op->index_reg, op->scale);
+        else
+            sprintf(buf + n, "(%s)", op->frame ? "%rbp" : op->reg);
+    }
+    return buf;
+}
+
+static void eval(struct x86 *x, const struct ir_inst *value, const char **regs, unsigned n);
+static void pair(struct x86 *x, struct operand *a, struct operand *b, const char **regs, unsigned n);
+
+//
+// Evaluate an operand into the first of the `n` registers `regs`, or the
+// first two for the base and index of an address.
+//
+static void eval_operand(struct x86 *x, struct operand *op, const char **regs, unsigned n)
+{
+    struct operand base, index;
+
+    if (!op->need)
+        return;
+
+    if (!op->memory) {
+        eval(x, op->value, regs, n);
+        op->reg = regs[0];
+        return;
+    }
+
+    register_operand(x, &base, op->frame || op->global ? NULL : op->value);
+    register_operand(x, &index, op->index);
+    pair(x, &base, &index, regs, n);
+    op->reg = base.reg;
+    op->index_reg = index.reg;
+}
+
+//
+// Evaluate two operands out of the `n` registers `regs`. Each one keeps its
+// registers while the other one is evaluated, so the order needing fewer
+// registers is taken; a value `a` ends up in regs[0] either way. If there
+// are too few registers, `b` waits on the stack and comes back in the
+// temporary register.
+//
+static void pair(struct x86 *x, struct operand *a, struct operand *b, const char **regs, unsigned n)
+{
+    const char *order[NUM_SCRATCH + 1];
+    unsigned i, a_first, b_first;
+    char buf[64];
+
+    if (!a->need || !b->need) {
+        eval_operand(x, a, regs, n);
+        eval_operand(x, b, regs, n);
+        return;
+    }
+
+    a_first = a->need > a->hold + b->need ? a->need : a->hold + b->need;
+    b_first = b->need > b->hold + a->need ? b->need : b->hold + a->need;
+
+    if (a_first <= n && a_first <= b_first) {
+        eval_operand(x, a, regs, n);
+        eval_operand(x, b, regs + a->hold, n - a->hold);
+    }
+    else if (b_first <= n) {
+        // `b` keeps the registers after regs[0], which stays free for `a`
+        for (i = 1; i < n; i++)
+            order[i - 1] = regs[i];
+        order[n - 1] = regs[0];
+        eval_operand(x, b, order, n);
+
+        order[0] = regs[0];
+        for (i = b->hold + 1; i < n; i++)
+            order[i - b->hold] = regs[i];
+        eval_operand(x, a, order, n - b->hold);
+    }
+    else {
+        eval_operand(x, b, regs, n);
+        if (b->memory) {
+            // an address goes to the stack as a single register
+            fprintf(x->out, "  lea %s, %s\n", format(x, b, buf), regs[0]);
+            b->frame = false;
+            b->global = NULL;
+            b->index = NULL;
+            b->index_reg = NULL;
+            b->disp = 0;
+        }
+        fprintf(x->out, "  push %s\n", regs[0]);
+        eval_operand(x, a, regs, n);
+        fprintf(x->out, "  pop %s\n", x->temp);
+        b->reg = x->temp;
+    }
+}
+
+//
+// Return k if `c` is 2^k with 0 < k < 63, and 0 otherwise.
+//
+static inline int power_of_two(uintptr_t c)
+{
+    int k = 0;
+
+    if (c < 2 || (c & (c - 1)) || c > (uintptr_t) 1 << 62)
+        return 0;
+    while (c >>= 1)
+        k++;
+    return k;
+}
+
+//
+// Find the magic number `m` and shift `s` such that the high word of `m`
+// times a number, shifted right by `s`, gives the number divided by `d`,
+// rounding towards minus infinity (Hacker's Delight, 10-1). |d| >= 2.
+//
+static void division_magic(intptr_t d, intptr_t *m, int *s)
+{
+    const uintptr_t two63 = (uintptr_t) 1 << 63;
+    uintptr_t ad = d < 0 ? -(uintptr_t) d : (uintptr_t) d;
+    uintptr_t t = two63 + ((uintptr_t) d >> 63);
+    uintptr_t anc = t - 1 - t % ad;
+    uintptr_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uintptr_t q2 = two63 / ad, r2 = two63 - q2 * ad, delta;
+    int p = 63;
+
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *m = d < 0 ? -(intptr_t) (q2 + 1) : (intptr_t) (q2 + 1);
+    *s = p - 64;
+}
+
+//
+// Multiply `dst` by the constant `c` with shifts and lea where that is
+// cheaper than imul. Return false if it is not.
+//
+static bool multiply_by(struct x86 *x, const char *dst, intptr_t c)
+{
+    static const intptr_t lea_factors[] = { 3, 5, 9 };
+    int k = power_of_two(c);
+    unsigned i;
+
+    if (c == 1)
+        return true;
+    if (c == -1) {
+        fprintf(x->out, "  neg %s\n", dst);
+        return true;
+    }
+    if (k) {
+        fprintf(x->out, "  shl $%d, %s\n", k, dst);
+        return true;
+    }
+
+    // (2^k + 1) * 2^j
+    for (i = 0; i < sizeof(lea_factors) / sizeof(intptr_t); i++) {
+        if (c % lea_factors[i] || (c != lea_factors[i] && !power_of_two(c / lea_factors[i])))
+            continue;
+        fprintf(x->out, "  lea (%s,%s,%ld), %s\n", dst, dst, lea_factors[i] - 1, dst);
+        if (c != lea_factors[i])
+            fprintf(x->out, "  shl $%d, %s\n", power_of_two(c / lea_factors[i]), dst);
+        return true;
+    }
+    return false;
+}
+
+//
+// Divide `dst` by the constant `c`, or take the remainder, without idiv:
+// powers of two are shifted with a correction that rounds negative numbers
+// towards zero, other divisors multiplied by their magic number. Return
+// false for divisors this does not handle.
+//
+static bool divide_by(struct x86 *x, enum ir_op op, const char *dst, intptr_t c)
+{
+    FILE *out = x->out;
+    uintptr_t ac = c < 0 ? -(uintptr_t) c : (uintptr_t) c;
+    int k = power_of_two(ac), shift;
+    intptr_t m;
+
+    if (c == 0 || c == INTPTR_MIN)
+        return false;
+    if (ac == 1) {
+        if (op == IR_MOD)
+            fprintf(out, "  mov $0, %s\n", dst);
+        else if (c < 0)
+            fprintf(out, "  neg %s\n", dst);
+        return true;
+    }
+
+    if (k && (op == IR_DIV || k < 32)) {
+        // add 2^k - 1 to negative numbers
+        fprintf(out, "  mov %s, %%rax\n  sar $63, %%rax\n  shr $%d, %%rax\n  add %s, %%rax\n", dst, 64 - k, dst);
+        if (op == IR_DIV)
+            fprintf(out, "  sar $%d, %%rax\n  mov %%rax, %s\n", k, dst);
+        else
+            fprintf(out, "  and $%ld, %%rax\n  sub %%rax, %s\n", -(intptr_t) ((uintptr_t) 1 << k), dst);
+        if (op == IR_DIV && c < 0)
+            fprintf(out, "  neg %s\n", dst);
+        return true;
+    }
+
+    // the quotient goes to %rdx, rounded up by one if it is negative
+    division_magic(c, &m, &shift);
+    fprintf(out, "  mov $%ld, %%rax\n  imulq %s\n", m, dst);
+    if (c > 0 && m < 0)
+        fprintf(out, "  add %s, %%rdx\n", dst);
+    else if (c < 0 && m > 0)
+        fprintf(out, "  sub %s, %%rdx\n", dst);
+    if (shift)
+        fprintf(out, "  sar $%d, %%rdx\n", shift);
+    fprintf(out, "  mov %%rdx, %%rax\n  shr $63, %%rax\n  add %%rax, %%rdx\n");
+
+    if (op == IR_DIV)
+        fprintf(out, "  mov %%rdx, %s\n", dst);
+    else if (fits_imm32(c))
+        fprintf(out, "  imul $%ld, %%rdx\n  sub %%rdx, %s\n", c, dst);
+    else
+        fprintf(out, "  mov $%ld, %%rax\n  imul %%rax, %%rdx\n  sub %%rdx, %s\n", c, dst);
+    return true;
+}
+
+//
+// Tell whether computing a value overwrites %rdx, as idiv and division by a
+// magic number do.
+//
+static bool overwrites_rdx(const struct ir_inst *value)
+{
+    const struct ir_inst *b;
+    uintptr_t ac;
+    int k;
+
+    if (value->op != IR_DIV && value->op != IR_MOD)
+        return false;
+    b = value->args[1].value;
+    if (b->op != IR_CONST || b->imm == 0 || b->imm == INTPTR_MIN)
+        return true;
+    ac = b->imm < 0 ? -(uintptr_t) b->imm : (uintptr_t) b->imm;
+    k = power_of_two(ac);
+    return ac != 1 && !(k && (value->op == IR_DIV || k < 32));
+}
+
+//
+// Compare the register `reg` with `src`. Zero is compared with by testing
+// the register, which sets the same flags.
+//
+static void compare(struct x86 *x, const char *src, const char *reg)
+{
+    if (!strcmp(src, "$0"))
+        fprintf(x->out, "  test %s, %s\n", reg, reg);
+    else
+        fprintf(x->out, "  cmp %s, %s\n", src, reg);
+}
+
+//
+// Apply a binary operator to `dst` and the operand `b`, which is in the
+// register or memory operand `rb` unless it is a leaf.
+//
+static void arithmetic(struct x86 *x, enum ir_op op, const char *dst, const struct ir_inst *b, const char *rb)
+{
+    FILE *out = x->out;
+    char buf[64];
+    const char *src, *name;
+
+    // multiplying and dividing by constants is cheaper without imul or idiv
+    if (!rb && b->op == IR_CONST && op == IR_MUL && multiply_by(x, dst, b->imm))
+        return;
+    if (!rb && b->op == IR_CONST && (op == IR_DIV || op == IR_MOD) && divide_by(x, op, dst, b->imm))
+        return;
+
+    switch (op) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_AND:
+    case IR_OR:
+        src = rb ? rb : source(x, b, x->temp, true, buf);
+        fprintf(out, "  %s %s, %s\n", arith_instructions[op], src, dst);
+        break;
+
+    case IR_DIV:
+    case IR_MOD:
+        // a divisor in %rax or %rdx moves to `dst` once the dividend is out
+        src = rb ? rb : source(x, b, x->temp, false, buf);
+        if (strstr(src, "%rax")) {
+            if (strcmp(src, "%rax"))
+                fprintf(out, "  mov %s, %%rax\n", src);
+            fprintf(out, "  xchg %%rax, %s\n", dst);
+            src = dst;
+        }
+        else {
+            fprintf(out, "  mov %s, %%rax\n", dst);
+            if (strstr(src, "%rdx")) {
+                fprintf(out, "  mov %s, %s\n", src, dst);
+                src = dst;
+            }
+        }
+        fprintf(out, "  cqo\n  idivq %s\n  mov %s, %s\n", src, op == IR_DIV ? "%rax" : "%rdx", dst);
+        break;
+
+    case IR_SHL:
+    case IR_SAR:
+        name = op == IR_SHL ? "shl" : "sar";
+        if (!rb && b->op == IR_CONST && b->imm >= 0 && b->imm < 64) {
+            fprintf(out, "  %s $%ld, %s\n", name, b->imm, dst);
+            break;
+        }
+        src = rb ? rb : source(x, b, x->temp, false, buf);
+        if (!strcmp(src, "%rcx"))
+            fprintf(out, "  %s %%cl, %s\n", name, dst);
+        else if (!x->keeps_rcx)
+            fprintf(out, "  mov %s, %%rcx\n  %s %%cl, %s\n", src, name, dst);
+        else {
+            // the count trades places with the value in %rcx and back
+            if (*src != '%') {
+                fprintf(out, "  mov %s, %s\n", src, x->temp);
+                src = x->temp;
+            }
+            fprintf(out, "  xchg %s, %%rcx\n  %s %%cl, %s\n  xchg %s, %%rcx\n",
+                    src, name, !strcmp(dst, src) ? "%rcx" : !strcmp(dst, "%rcx") ? src : dst, src);
+        }
+        break;
+
+    default:
+        src = rb ? rb : source(x, b, x->temp, true, buf);
+        compare(x, src, dst);
+        fprintf(out,
+            "  set%s %%al\n"
+            "  movzb %%al, %s\n",
+            condition_codes[op - IR_LT], dst
+        );
+    }
+}
+
+//
+// Compute a binary operator into `dst`, using only the `n` registers `regs`.
+// `dst` is either regs[0] or a register that already holds the first operand.
+//
+static void binary(struct x86 *x, const struct ir_inst *value, const char *dst, const char **regs, unsigned n)
+{
+    const struct ir_inst *b = value->args[1].value;
+    struct operand a_op, b_op;
+    char buf[64];
+
+    value_operand(x, &a_op, value->args[0].value, false);
+    if (dst != regs[0])
+        a_op.need = a_op.hold = 0;
+    if (folded(x, b))
+        memory_operand(x, &b_op, b->args[0].value);
+    else
+        value_operand(x, &b_op, b, true);
+
+    pair(x, &a_op, &b_op, regs, n);
+    arithmetic(x, value->op, dst, b, b_op.need || b_op.memory ? format(x, &b_op, buf) : NULL);
+}
+
+//
+// Compute the value of an instruction with operands into regs[0], using only
+// the `n` registers `regs`.
+//
+static void compute(struct x86 *x, const struct ir_inst *value, const char **regs, unsigned n)
+{
+    const struct ir_inst *a = value->args[0].value;
+    struct operand op;
+    char buf[64];
+
+    switch (value->op) {
+    case IR_NEG:
+        eval(x, a, regs, n);
+        fprintf(x->out, "  neg %s\n", regs[0]);
+        break;
+
+    case IR_LOAD:
+        memory_operand(x, &op, a);
+        eval_operand(x, &op, regs, n);
+        fprintf(x->out, "  mov %s, %s\n", format(x, &op, buf), regs[0]);
+        break;
+
+    default:
+        binary(x, value, regs[0], regs, n);
+    }
+}
+
+//
+// Evaluate a value into regs[0], using only the `n` registers `regs`.
+//
+static void eval(struct x86 *x, const struct ir_inst *value, const char **regs, unsigned n)
+{
+    if (is_tree(x, value))
+        compute(x, value, regs, n);
+    else
+        load(x, value, regs[0]);
+}
+
+//
+// Evaluate a value into `reg`, which need not be a scratch register.
+//
+static void eval_into(struct x86 *x, const struct ir_inst *value, const char *reg)
+{
+    if (!is_tree(x, value))
+        load(x, value, reg);
+    else {
+        eval(x, value, x->scratch, x->num_scratch);
+        fprintf(x->out, "  mov %s, %s\n", x->scratch[0], reg);
+    }
+}
+
+//
+// Copy the registers `src` to the registers `dst` all at once; no register
+// is in `dst` twice. %rax breaks cycles, so it must not be in `dst`.
+//
+static void parallel_move(struct x86 *x, const char **src, const char **dst, unsigned n)
+{
+    const char *cycle;
+    unsigned i, j;
+
+    while (n) {
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < n && (j == i || strcmp(src[j], dst[i])); j++);
+            if (j == n)
+                break;
+        }
+
+        if (i == n) {
+            // every destination is still needed as a source: break the cycle
+            fprintf(x->out, "  mov %s, %%rax\n", cycle = src[0]);
+            for (j = 0; j < n; j++)
+                if (!strcmp(src[j], cycle))
+                    src[j] = "%rax";
+            continue;
+        }
+
+        if (strcmp(src[i], dst[i]))
+            fprintf(x->out, "  mov %s, %s\n", src[i], dst[i]);
+        src[i] = src[--n];
+        dst[i] = dst[n];
+    }
+}
+
+static void jump(struct x86 *x, const char *instruction, const struct ir_block *target)
+{
+    fprintf(x->out, "  %s ", instruction);
+    block_label(x, x->target[target->id]);
+    fprintf(x->out, "\n");
+}
+
+//
+// Jump to `target` unless it comes next anyway.
+//
+static void jump_unless_next(struct x86 *x, const struct ir_block *bb, const struct ir_block *target)
+{
+    if (x->next[bb->id] != x->target[target->id])
+        jump(x, "jmp", target);
+}
+
+//
+// Generate the conditional branch ending `bb`. A comparison in the tree of
+// the condition sets the flags the jump tests instead of a boolean, and a
+// comparison to zero only flips the branch.
+//
+static void branch(struct x86 *x, const struct ir_block *bb)
+{
+    const struct ir_inst *cond = bb->last->args[0].value, *a, *b;
+    const char *src, *reg = x->scratch[0];
+    enum ir_op op = IR_NE;
+    struct operand a_op, b_op;
+    bool negate = false;
+    char buf[64];
+
+    while (is_tree(x, cond) && (cond->op == IR_EQ || cond->op == IR_NE) && cond->args[1].value->op == IR_CONST && !cond->args[1].value->imm) {
+        negate ^= cond->op == IR_EQ;
+        cond = cond->args[0].value;
+    }
+
+    if (is_tree(x, cond) && ir_is_cmp(cond->op)) {
+        op = cond->op;
+        a = cond->args[0].value;
+        b = cond->args[1].value;
+
+        // a constant is compared with as an immediate
+        if (is_imm32(a) && !is_imm32(b)) {
+            op = swapped_comparisons[op - IR_LT];
+            a = b;
+            b = cond->args[0].value;
+        }
+        register_operand(x, &a_op, a);
+        if (folded(x, b))
+            memory_operand(x, &b_op, b->args[0].value);
+        else
+            value_operand(x, &b_op, b, true);
+        pair(x, &a_op, &b_op, x->scratch, x->num_scratch);
+        src = b_op.need || b_op.memory ? format(x, &b_op, buf) : source(x, b, x->temp, true, buf);
+        compare(x, src, a_op.reg);
+    }
+    else {
+        if (!is_tree(x, cond) && x->reg[cond->id])
+            reg = x->reg[cond->id];
+        else
+            eval(x, cond, x->scratch, x->num_scratch);
+        fprintf(x->out, "  test %s, %s\n", reg, reg);
+    }
+
+    // jump to the first successor if the condition holds, unless it comes
+    // next, in which case the other one is jumped to if it does not
+    if (x->next[bb->id] == x->target[bb->succs[0]->id]) {
+        sprintf(buf, "j%s", (negate ? condition_codes : inverse_condition_codes)[op - IR_LT]);
+        jump(x, buf, bb->succs[1]);
+    }
+    else {
+        sprintf(buf, "j%s", (negate ? inverse_condition_codes : condition_codes)[op - IR_LT]);
+        jump(x, buf, bb->succs[0]);
+        jump_unless_next(x, bb, bb->succs[1]);
+    }
+}
+
+struct switch_case {
+    intptr_t value;
+    unsigned index; /* position among the successors */
+    const struct ir_block *target;
+};
+
+static int compare_cases(const void *a, const void *b)
+{
+    const struct switch_case *x = a, *y = b;
+
+    if (x->value != y->value)
+        return x->value < y->value ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+//
+// Compare the value of a switch in `reg` with `value`.
+//
+static void compare_case(struct x86 *x, const char *reg, intptr_t value)
+{
+    if (!value)
+        compare(x, "$0", reg);
+    else if (fits_imm32(value))
+        fprintf(x->out, "  cmp $%ld, %s\n", value, reg);
+    else
+        fprintf(x->out, "  mov $%ld, %s\n  cmp %s, %s\n", value, x->temp, x->temp, reg);
+}
+
+//
+// Go to the target of the case among the sorted `cases` that the value in
+// `reg` matches, or to `other` if there is none. `label` numbers the labels
+// of the search and the jump tables within the switch ending `bb`, and
+// `last` tells whether the code comes last, before the next block.
+//
+static void dispatch(struct x86 *x, const struct ir_block *bb, const char *reg, const struct switch_case *cases,
+                     size_t n, const struct ir_block *other, unsigned *label, bool last)
+{
+    FILE *out = x->out;
+    uintptr_t range, v;
+    size_t i, half;
+    unsigned lower;
+
+    if (n <= SWITCH_LINEAR) {
+        for (i = 0; i < n; i++) {
+            compare_case(x, reg, cases[i].value);
+            jump(x, "je", cases[i].target);
+        }
+        if (last)
+            jump_unless_next(x, bb, other);
+        else
+            jump(x, "jmp", other);
+        return;
+    }
+
+    range = (uintptr_t) cases[n - 1].value - cases[0].value;
+    if (range < n * SWITCH_DENSITY) {
+        // the offsets of the targets from the table, indexed by value - min;
+        // the first scratch register is free once the value is in %rax
+        fprintf(out, "  mov %s, %%rax\n", reg);
+        if (cases[0].value && fits_imm32(cases[0].value))
+            fprintf(out, "  sub $%ld, %%rax\n", cases[0].value);
+        else if (cases[0].value)
+            fprintf(out, "  mov $%ld, %s\n  sub %s, %%rax\n", cases[0].value, x->scratch[0], x->scratch[0]);
+        fprintf(out, "  cmp $%lu, %%rax\n", range);
+        jump(x, "ja", other);
+        fprintf(out,
+            "  lea .L.table%u.%u.%s(%%rip), %s\n"
+            "  movslq (%s,%%rax,4), %%rax\n"
+            "  add %s, %%rax\n"
+            "  jmp *%%rax\n"
+            ".section .rodata\n"
+            "  .p2align 2\n"
+            ".L.table%u.%u.%s:\n",
+            bb->id, *label, x->fn->name, x->scratch[0], x->scratch[0], x->scratch[0], bb->id, *label, x->fn->name);
+        for (v = 0, i = 0; v <= range; v++) {
+            fprintf(out, "  .long ");
+            block_label(x, x->target[((uintptr_t) cases[i].value - cases[0].value == v ? cases[i].target : other)->id]);
+            fprintf(out, " - .L.table%u.%u.%s\n", bb->id, *label, x->fn->name);
+            while (i < n && (uintptr_t) cases[i].value - cases[0].value == v)
+                i++;
+        }
+        fprintf(out, ".text\n");
+        ++*label;
+        return;
+    }
+
+    // look for values below the middle case after those above it
+    half = n / 2;
+    lower = (*label)++;
+    compare_case(x, reg, cases[half].value);
+    jump(x, "je", cases[half].target);
+    fprintf(out, "  jl .L.case%u.%u.%s\n", bb->id, lower, x->fn->name);
+    dispatch(x, bb, reg, cases + half + 1, n - half - 1, other, label, false);
+    fprintf(out, ".L.case%u.%u.%s:\n", bb->id, lower, x->fn->name);
+    dispatch(x, bb, reg, cases, half, other, label, last);
+}
+
+//
+// Generate the switch ending `bb` on the value in `reg`. Of cases with the
+// same value, the first one wins.
+//
+static void switch_dispatch(struct x86 *x, const struct ir_block *bb, const char *reg)
+{
+    struct switch_case *cases = malloc(bb->num_succs * sizeof(struct switch_case));
+    unsigned i, n = 0, label = 0;
+
+    for (i = 1; i < bb->num_succs; i++)
+        cases[n++] = (struct switch_case) { bb->last->cases[i], i, bb->succs[i] };
+    qsort(cases, n, sizeof(struct switch_case), compare_cases);
+
+    for (i = 1, n = n ? 1 : 0; i < bb->num_succs - 1; i++)
+        if (cases[i].value != cases[n - 1].value)
+            cases[n++] = cases[i];
+
+    dispatch(x, bb, reg, cases, n, bb->succs[0], &label, true);
+    free(cases);
+}
+
+//
+// Give the phi nodes of `to` their operands for the edge from `from`.
+// All operands are read before any phi node is written, as one of them
+// may be another phi node of `to`.
+//
+static void phi_copies(struct x86 *x, const struct ir_block *from, const struct ir_block *to)
+{
+    int i = ir_pred_index(to, from);
+    const char *src[NUM_LEAF_ALLOCATABLE], *dst[NUM_LEAF_ALLOCATABLE];
+    struct ir_inst *phi, *value, *last = NULL;
+    unsigned n = 0, k = 0;
+
+    // operands for phi nodes on the stack go to scratch registers, or to the
+    // stack if there are too many; constants can wait
+    ir_foreach_phi(phi, to)
+        if (x->home[phi->id] && !is_imm32(phi->args[i].value))
+            n++;
+    ir_foreach_phi(phi, to) {
+        if (!x->home[phi->id] || is_imm32(phi->args[i].value))
+            continue;
+        last = phi;
+        if (n <= x->num_scratch)
+            load(x, phi->args[i].value, x->scratch[k++]);
+        else {
+            load(x, phi->args[i].value, "%rax");
+            fprintf(x->out, "  push %%rax\n");
+        }
+    }
+
+    // then registers are copied to registers, all at once
+    k = 0;
+    ir_foreach_phi(phi, to) {
+        value = phi->args[i].value;
+        if (x->reg[phi->id] && x->reg[value->id]) {
+            src[k] = x->reg[value->id];
+            dst[k++] = x->reg[phi->id];
+        }
+    }
+    parallel_move(x, src, dst, k);
+
+    ir_foreach_phi(phi, to)
+        if (x->reg[phi->id] && !x->reg[phi->args[i].value->id])
+            load(x, phi->args[i].value, x->reg[phi->id]);
+
+    k = 0;
+    ir_foreach_phi(phi, to) {
+        if (!x->home[phi->id])
+            continue;
+        if (is_imm32(phi->args[i].value))
+            fprintf(x->out, "  movq $%ld, %ld(%%rbp)\n", phi->args[i].value->imm, x->home[phi->id]);
+        else if (n <= x->num_scratch)
+            fprintf(x->out, "  mov %s, %ld(%%rbp)\n", x->scratch[k++], x->home[phi->id]);
+    }
+    if (n <= x->num_scratch)
+        return;
+    for (phi = last; phi; phi = phi->prev)
+        if (x->home[phi->id] && !is_imm32(phi->args[i].value))
+            fprintf(x->out, "  pop %ld(%%rbp)\n", x->home[phi->id]);
+}
+
+//
+// Write a value computed in `reg` where it is kept, if anywhere.
+//
+static void keep(struct x86 *x, const struct ir_inst *value, const char *reg)
+{
+    if (x->reg[value->id] && strcmp(x->reg[value->id], reg))
+        fprintf(x->out, "  mov %s, %s\n", reg, x->reg[value->id]);
+    else if (x->home[value->id])
+        fprintf(x->out, "  mov %s, %ld(%%rbp)\n", reg, x->home[value->id]);
+}
+
+//
+// Restore the callee-saved registers in use and drop the frame, if any.
+// Without one, the registers were pushed.
+//
+static void epilogue(struct x86 *x)
+{
+    unsigned i;
+
+    for (i = x->num_allocatable; i-- > 0;) {
+        if (x->saved[i] && x->frame)
+            fprintf(x->out, "  mov %ld(%%rbp), %s\n", x->saved[i], x->allocatable[i]);
+        else if (x->saved[i])
+            fprintf(x->out, "  pop %s\n", x->allocatable[i]);
+    }
+    if (x->frame)
+        fprintf(x->out, "  leave\n");
+}
+
+//
+// Tell whether a call is followed by the return of its value, so that the
+// callee can return to the caller of this function instead.
+//
+static bool is_tail_call(const struct x86 *x, const struct ir_inst *inst)
+{
+    return x->private_frame && inst->op == IR_CALL && inst->next
+        && inst->next->op == IR_RET && inst->next->args[0].value == inst;
+}
+
+//
+// Generate code for a call. Argument trees are evaluated into scratch
+// registers first, then moved to the argument registers. Named functions
+// are called directly; only computed callees go through %r10. Tail calls
+// drop the frame and jump.
+//
+static void call(struct x86 *x, const struct ir_inst *inst)
+{
+    const char *op = is_tail_call(x, inst) ? "jmp" : "call";
+    const char *src[MAX_FN_CALL_ARGS], *dst[MAX_FN_CALL_ARGS];
+    const struct ir_inst *arg, *callee;
+    unsigned i, n = 0;
+
+    for (i = 1; i < inst->num_args; i++) {
+        arg = inst->args[i].value;
+        if (is_tree(x, arg)) {
+            eval(x, arg, x->scratch + n, x->num_scratch - n);
+            src[n] = x->scratch[n];
+            dst[n++] = arg_registers[i - 1];
+        }
+    }
+    parallel_move(x, src, dst, n);
+
+    for (i = 1; i < inst->num_args; i++)
+        if (!is_tree(x, inst->args[i].value))
+            load(x, inst->args[i].value, arg_registers[i - 1]);
+
+    callee = inst->args[0].value;
+    if (callee->op != IR_GLOBAL)
+        load(x, callee, "%r10");
+    if (*op == 'j')
+        epilogue(x);
+    if (callee->op == IR_GLOBAL)
+        fprintf(x->out, "  %s %s\n", op, callee->name);
+    else
+        fprintf(x->out, "  %s *%%r10\n", op);
+}
+
+//
+// Tell whether two addresses are the same: the same slot, global or value,
+// plus the same constant if any.
+//
+static bool same_address(const struct ir_inst *a, const struct ir_inst *b)
+{
+    if (a == b)
+        return true;
+    if (a->op != b->op)
+        return false;
+    if (a->op == IR_ADD)
+        return same_address(a->args[0].value, b->args[0].value) && a->args[1].value->op == IR_CONST
+            && b->args[1].value->op == IR_CONST && a->args[1].value->imm == b->args[1].value->imm;
+    return (a->op == IR_SLOT && a->imm == b->imm) || (a->op == IR_GLOBAL && !strcmp(a->name, b->name));
+}
+
+//
+// Tell whether the expression tree of `value` reads the register `reg`.
+//
+static bool reads_register(const struct x86 *x, const struct ir_inst *value, const char *reg)
+{
+    unsigned i;
+
+    if (!is_tree(x, value))
+        return x->reg[value->id] == reg;
+    for (i = 0; i < value->num_args; i++)
+        if (reads_register(x, value->args[i].value, reg))
+            return true;
+    return false;
+}
+
+//
+// Generate a store of an operator applied to what is loaded from the same
+// address as one instruction on memory, like `addq $1, x(%rip)`.
+// Return whether the store has that form.
+//
+static bool read_modify_write(struct x86 *x, const struct ir_inst *store)
+{
+    const struct ir_inst *addr = store->args[0].value, *value = store->args[1].value;
+    const struct ir_inst *loaded, *other = NULL;
+    struct operand mem, op;
+    const char *rb, *name;
+    char buf[64], dst[64];
+
+    if (!is_tree(x, value))
+        return false;
+
+    switch (value->op) {
+    case IR_NEG:
+        loaded = value->args[0].value;
+        break;
+    case IR_ADD:
+    case IR_AND:
+    case IR_OR:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_SHL:
+    case IR_SAR:
+        loaded = value->args[0].value;
+        other = value->args[1].value;
+
+        // the loaded value may come second if the order does not matter
+        if ((value->op == IR_ADD || value->op == IR_AND || value->op == IR_OR || value->op == IR_MUL) && other->op == IR_LOAD && is_tree(x, other)
+                && same_address(other->args[0].value, addr)) {
+            loaded = other;
+            other = value->args[0].value;
+        }
+
+        // only multiplications by powers of two are shifts
+        if (value->op == IR_MUL && (other->op != IR_CONST || !power_of_two(other->imm)))
+            return false;
+
+        // %rcx cannot trade places with a count when it is in the address
+        if ((value->op == IR_SHL || value->op == IR_SAR) && x->keeps_rcx
+                && (other->op != IR_CONST || other->imm < 0 || other->imm >= 64))
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    if (!is_tree(x, loaded) || loaded->op != IR_LOAD || !same_address(loaded->args[0].value, addr))
+        return false;
+
+    memory_operand(x, &mem, addr);
+    value_operand(x, &op, other, true);
+    pair(x, &mem, &op, x->scratch, x->num_scratch);
+    format(x, &mem, dst);
+    rb = op.need ? op.reg : NULL;
+
+    if (value->op == IR_NEG) {
+        fprintf(x->out, "  negq %s\n", dst);
+        return true;
+    }
+
+    if (value->op == IR_MUL) {
+        fprintf(x->out, "  shlq $%d, %s\n", power_of_two(other->imm), dst);
+        return true;
+    }
+
+    if (value->op == IR_SHL || value->op == IR_SAR) {
+        name = value->op == IR_SHL ? "shlq" : "sarq";
+        if (!rb && other->op == IR_CONST && other->imm >= 0 && other->imm < 64) {
+            fprintf(x->out, "  %s $%ld, %s\n", name, other->imm, dst);
+            return true;
+        }
+        if (!rb)
+            rb = source(x, other, x->temp, false, buf);
+        if (strcmp(rb, "%rcx"))
+            fprintf(x->out, "  mov %s, %%rcx\n", rb);
+        fprintf(x->out, "  %s %%cl, %s\n", name, dst);
+        return true;
+    }
+
+    if (!rb && x->home[other->id]) {
+        // there is no operation from memory to memory
+        load(x, other, x->temp);
+        rb = x->temp;
+    }
+    else if (!rb)
+        rb = source(x, other, x->temp, true, buf);
+    fprintf(x->out, "  %sq %s, %s\n", arith_instructions[value->op], rb, dst);
+    return true;
+}
+
+//
+// Move the arguments to where they are kept, all at once, as one of them may
+// be kept in the register another one comes in.
+//
+static void move_arguments(struct x86 *x)
+{
+    const char *src[MAX_FN_CALL_ARGS], *dst[MAX_FN_CALL_ARGS];
+    const struct ir_inst *param;
+    unsigned n = 0;
+
+    for (param = x->fn->entry->first; param && param->op == IR_PARAM; param = param->next) {
+        if (x->home[param->id])
+            fprintf(x->out, "  mov %s, %ld(%%rbp)\n", arg_registers[param->imm], x->home[param->id]);
+        else if (x->reg[param->id]) {
+            src[n] = arg_registers[param->imm];
+            dst[n++] = x->reg[param->id];
+        }
+    }
+    parallel_move(x, src, dst, n);
+}
+
+//
+// Generate code for an instruction that is not part of an expression tree.
+//
+static void instruction(struct x86 *x, const struct ir_inst *inst)
+{
+    FILE *out = x->out;
+    const struct ir_block *bb = inst->block;
+    const struct ir_inst *a = inst->num_args > 0 ? inst->args[0].value : NULL;
+    const struct ir_inst *b = inst->num_args > 1 ? inst->args[1].value : NULL;
+    const char *reg = x->scratch[0], *rb, *regs[NUM_SCRATCH + 1];
+    struct operand mem, op;
+    char buf[64], dst[64];
+
+    switch (inst->op) {
+    case IR_CONST:
+    case IR_STRING:
+    case IR_GLOBAL:
+    case IR_SLOT:
+    case IR_PHI:
+        return; /* loaded where they are used, or set by the predecessors */
+
+    case IR_PARAM:
+        if (!inst->prev)
+            move_arguments(x);
+        return;
+
+    case IR_STORE:
+        if (read_modify_write(x, inst))
+            return;
+        memory_operand(x, &mem, a);
+        value_operand(x, &op, b, true);
+        pair(x, &mem, &op, x->scratch, x->num_scratch);
+        rb = op.need ? op.reg : NULL;
+        if (!rb && x->home[b->id]) {
+            // there is no move from memory to memory
+            load(x, b, x->temp);
+            rb = x->temp;
+        }
+        else if (!rb)
+            rb = source(x, b, x->temp, true, buf);
+        fprintf(out, "  movq %s, %s\n", rb, format(x, &mem, dst));
+        return;
+
+    case IR_CALL:
+        call(x, inst);
+        if (!is_tail_call(x, inst))
+            keep(x, inst, "%rax");
+        return;
+
+    case IR_JMP:
+        phi_copies(x, bb, bb->succs[0]);
+        jump_unless_next(x, bb, bb->succs[0]);
+        return;
+
+    case IR_BR:
+        branch(x, bb);
+        return;
+
+    case IR_SWITCH:
+        if (x->reg[a->id])
+            reg = x->reg[a->id];
+        else
+            eval(x, a, x->scratch, x->num_scratch);
+        switch_dispatch(x, bb, reg);
+        return;
+
+    case IR_RET:
+        if (is_tail_call(x, a))
+            return; /* the callee returns */
+        eval_into(x, a, "%rax");
+        epilogue(x);
+        fprintf(out, "  ret\n");
+        return;
+
+    default:
+        // the root of an expression tree, computed right where it is kept
+        // unless that register is read after it would be written, or
+        // overwritten by a division
+        reg = x->reg[inst->id];
+        if (reg && overwrites_rdx(inst) && !strcmp(reg, "%rdx")) {
+            compute(x, inst, x->scratch, x->num_scratch);
+            keep(x, inst, x->scratch[0]);
+        }
+        else if (reg && !reads_register(x, inst, reg)) {
+            regs[0] = reg;
+            memcpy(regs + 1, x->scratch, x->num_scratch * sizeof(const char*));
+            compute(x, inst, regs, x->num_scratch + 1);
+        }
+        else if (reg && ir_is_binary(inst->op) && !is_tree(x, a) && x->reg[a->id] == reg && !reads_register(x, b, reg))
+            binary(x, inst, reg, x->scratch, x->num_scratch);
+        else if (reg || x->home[inst->id]) {
+            compute(x, inst, x->scratch, x->num_scratch);
+            keep(x, inst, x->scratch[0]);
+        }
+    }
+}
+
+//
+// Tell whether `user` may evaluate `value` as part of its expression tree.
+// Loads in the tree must not be moved across stores or calls, and arguments
+// stay in their registers only while nothing has been evaluated yet.
+//
+static bool can_inline(const struct ir_inst *value, const struct ir_inst *user,
+                       const unsigned *epoch, const unsigned *first_load, bool prologue)
+{
+    if (value->block != user->block || !value->uses || value->uses->next)
+        return false;
+    if (user->op == IR_PHI || (user->op == IR_CALL && value == user->args[0].value))
+        return false;
+
+    switch (value->op) {
+    case IR_PARAM:
+        return prologue && user->op == IR_STORE;
+    case IR_LOAD:
+    case IR_NEG:
+        break;
+    default:
+        if (!ir_is_binary(value->op))
+            return false;
+    }
+    return first_load[value->id] == NO_LOAD || first_load[value->id] == epoch[user->id];
+}
+
+//
+// Tell whether an instruction may appear before the stores of the incoming
+// arguments while these are still in their registers.
+//
+static bool in_prologue(const struct ir_inst *inst)
+{
+    unsigned i;
+
+    if (inst->op == IR_PARAM || rematerialized(inst))
+        return true;
+    if (inst->op != IR_STORE)
+        return false;
+    for (i = 0; i < inst->num_args; i++)
+        if (inst->args[i].value->op != IR_PARAM && !rematerialized(inst->args[i].value))
+            return false;
+    return true;
+}
+
+//
+// Tell whether memory_operand() makes an address into base, scaled index
+// and displacement without evaluating anything.
+//
+static bool is_addressing_mode(const struct x86 *x, const struct ir_inst *addr)
+{
+    const struct ir_inst *offset, *index;
+
+    if (addr->op != IR_ADD || is_tree(x, addr->args[0].value))
+        return false;
+    offset = addr->args[1].value;
+    if (is_imm32(offset))
+        return true;
+    if (!is_tree(x, offset) || offset->op != IR_SHL || offset->args[1].value->op != IR_CONST
+            || offset->args[1].value->imm < 0 || offset->args[1].value->imm > 3)
+        return false;
+    index = offset->args[0].value;
+    return !is_tree(x, index) || ((index->op == IR_ADD || index->op == IR_SUB)
+        && !is_tree(x, index->args[0].value) && is_imm32(index->args[1].value));
+}
+
+//
+// Let a store share its address with the load in its expression tree, as
+// in `v[i] =+ 1`, if the address costs nothing to form twice.
+//
+static void share_address(struct x86 *x, const struct ir_inst *store)
+{
+    const struct ir_inst *addr = store->args[0].value, *load = NULL, *user;
+    const struct ir_use *use;
+
+    if (x->inlined[addr->id] || addr->block != store->block || !is_addressing_mode(x, addr))
+        return;
+    for (use = addr->uses; use; use = use->next) {
+        if (use->user->op == IR_LOAD && !load)
+            load = use->user;
+        else if (use->user != store || store->args[1].value == addr)
+            return;
+    }
+    if (!load)
+        return;
+    for (user = load; x->inlined[user->id]; user = user->uses->user)
+        ;
+    if (user == store)
+        x->inlined[addr->id] = true;
+}
+
+//
+// Find the expression trees of every block: values used once, by a later
+// instruction of the same block, are evaluated there, in registers. In leaf
+// functions, divisions that overwrite %rdx are roots of their own, or
+// evaluated last by a return, so that a value kept there is read before it
+// is overwritten.
+//
+static void form_trees(struct x86 *x)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst, *value;
+    unsigned *epoch = malloc(x->fn->num_insts * sizeof(unsigned));
+    unsigned *first_load = malloc(x->fn->num_insts * sizeof(unsigned));
+    unsigned i, stores;
+    bool prologue = !x->leaf; /* leaf functions may keep values where arguments come in */
+
+    for (bb = x->fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first, stores = 0; inst; inst = inst->next) {
+            // number of stores and calls before the instruction in its block
+            epoch[inst->id] = stores;
+            first_load[inst->id] = inst->op == IR_LOAD ? stores : NO_LOAD;
+            prologue = prologue && in_prologue(inst);
+
+            for (i = 0; i < inst->num_args; i++) {
+                value = inst->args[i].value;
+                if (can_inline(value, inst, epoch, first_load, prologue)
+                        && !(x->leaf && overwrites_rdx(value) && inst->op != IR_RET)) {
+                    x->inlined[value->id] = true;
+                    if (first_load[value->id] < first_load[inst->id])
+                        first_load[inst->id] = first_load[value->id];
+                }
+            }
+
+            if (inst->op == IR_STORE)
+                share_address(x, inst);
+            if (inst->op == IR_STORE || inst->op == IR_CALL)
+                stores++;
+        }
+        prologue = false;
+    }
+
+    free(epoch);
+    free(first_load);
+}
+
+//
+// Number the nodes of the expression trees with the registers they need,
+// once it is known which leaves are in registers.
+//
+static void number_trees(struct x86 *x)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst, *b;
+    struct operand op;
+
+    for (bb = x->fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (inst->op == IR_NEG)
+                x->need[inst->id] = need(x, inst->args[0].value);
+            else if (inst->op == IR_LOAD) {
+                memory_operand(x, &op, inst->args[0].value);
+                x->need[inst->id] = op.need ? op.need : 1;
+            }
+            else if (ir_is_binary(inst->op)) {
+                b = inst->args[1].value;
+                if (folded(x, b))
+                    memory_operand(x, &op, b->args[0].value);
+                else
+                    value_operand(x, &op, b, true);
+                x->need[inst->id] = pair_need(need(x, inst->args[0].value), 1, op.need, op.hold);
+            }
+        }
+    }
+}
+
+//
+// Tell whether the addresses of the stack slots are only loaded from and
+// stored to, so that nothing outside the function can see its frame.
+//
+static bool is_frame_private(const struct ir_function *fn)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+    const struct ir_use *use;
+
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (inst->op == IR_SLOT)
+                for (use = inst->uses; use; use = use->next)
+                    if ((use->user->op != IR_LOAD && use->user->op != IR_STORE) || use != &use->user->args[0])
+                        return false;
+    return true;
+}
+
+//
+// Give the stack slots still addressed places in the frame, in order, and
+// return how many words they take. The slots promoted to values take none,
+// and a vector takes all of its slots. The slots below one whose address is
+// computed with keep their places, as they may be reached from it.
+//
+static uintmax_t place_slots(struct x86 *x)
+{
+    const struct ir_function *fn = x->fn;
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+    const struct ir_use *use;
+    bool *used = calloc(fn->num_slots, sizeof(bool));
+    uintmax_t slot, len, top = 0, words = 0;
+
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (inst->op != IR_SLOT || inst->imm < 0)
+                continue; /* an empty vector is the padding word */
+            len = inst->vector ? inst->vector : 1;
+            slot = (uintmax_t) inst->imm + 1 > len ? inst->imm + 1 - len : 0;
+            do
+                used[slot] = true;
+            while (slot++ < (uintmax_t) inst->imm);
+
+            for (use = inst->uses; use && !inst->vector; use = use->next)
+                if ((use->user->op != IR_LOAD && use->user->op != IR_STORE) || use != &use->user->args[0])
+                    if (top < (uintmax_t) inst->imm + 1)
+                        top = inst->imm + 1;
+        }
+    }
+
+    for (slot = 0; slot < fn->num_slots; slot++)
+        if (used[slot] || slot < top)
+            x->slots[slot] = words++;
+
+    free(used);
+    return words;
+}
+
+//
+// Tell whether a function calls nothing.
+//
+static bool is_leaf(const struct ir_function *fn)
+{
+    const struct ir_block *bb;
+    const struct ir_inst *inst;
+
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (inst->op == IR_CALL)
+                return false;
+    return true;
+}
+
+//
+// Tell whether a register must be saved by functions that use it.
+//
+static bool is_callee_saved(const char *reg)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_ALLOCATABLE; i++)
+        if (!strcmp(allocatable_registers[i], reg))
+            return true;
+    return false;
+}
+
+//
+// Tell whether a block only jumps on without copying anything for the phi
+// nodes of its successor, as the blocks splitting edges often do, so that
+// it can be left out.
+//
+static bool is_empty(const struct x86 *x, const struct ir_block *bb)
+{
+    const struct ir_inst *phi, *value;
+    int i;
+
+    if (bb == x->fn->entry || bb->first != bb->last || bb->last->op != IR_JMP)
+        return false;
+    i = ir_pred_index(bb->succs[0], bb);
+    ir_foreach_phi(phi, bb->succs[0]) {
+        value = phi->args[i].value;
+        if (x->home[phi->id] || (x->reg[phi->id] && (!x->reg[value->id] || strcmp(x->reg[phi->id], x->reg[value->id]))))
+            return false;
+    }
+    return true;
+}
+
+//
+// Move the blocks with the copies for a conditional branch back to the top
+// of a loop right before the top, so that the loop ends in a single jump.
+// Then leave out the empty blocks, jumping straight to where they lead
+// instead, and find the heads of loops among the blocks left: those jumped
+// to from themselves or from a block after them.
+//
+static void lay_out(struct x86 *x)
+{
+    struct ir_function *fn = x->fn;
+    struct ir_block *bb, **moved = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    const struct ir_block *last = NULL, *target;
+    unsigned *pos = malloc(fn->num_blocks * sizeof(unsigned));
+    unsigned i, n, num_moved = 0;
+
+    x->target = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    x->next = malloc(fn->num_blocks * sizeof(struct ir_block*));
+    x->head = calloc(fn->num_blocks, sizeof(bool));
+
+    for (bb = fn->entry, n = 0; bb; bb = bb->next)
+        pos[bb->id] = n++;
+    for (bb = fn->entry; bb; bb = bb->next)
+        if (bb->first == bb->last && bb->last->op == IR_JMP && bb->num_preds == 1 && bb->preds[0]->last->op == IR_BR
+            && pos[bb->succs[0]->id] <= pos[bb->preds[0]->id] && !is_empty(x, bb))
+            moved[num_moved++] = bb;
+    for (i = 0; i < num_moved; i++)
+        ir_move_block_after(fn, moved[i], moved[i]->succs[0]->prev);
+    free(moved);
+
+    // a loop of empty blocks stays
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (target = bb, n = 0; is_empty(x, target) && n < fn->num_blocks; n++)
+            target = target->succs[0];
+        x->target[bb->id] = is_empty(x, target) ? bb : target;
+    }
+
+    for (bb = fn->exit; bb; bb = bb->prev) {
+        x->next[bb->id] = last;
+        if (x->target[bb->id] == bb)
+            last = bb;
+    }
+
+    for (bb = fn->entry, n = 0; bb; bb = bb->next)
+        pos[bb->id] = n++;
+    for (bb = fn->entry; bb; bb = bb->next) {
+        if (x->target[bb->id] != bb)
+            continue;
+        for (i = 0; i < bb->num_succs; i++) {
+            target = x->target[bb->succs[i]->id];
+            if (pos[target->id] <= pos[bb->id])
+                x->head[target->id] = true;
+        }
+    }
+    free(pos);
+}
+
+void x86_function(struct compiler_args *args, FILE *out, struct ir_function *fn, const struct codegen_ids *ids)
+{
+    struct x86 x = { args, out, fn, ids, NULL, NULL, NULL, NULL, 0, NULL, false, NULL, 0, { 0 }, false, NULL, NULL, is_frame_private(fn), is_leaf(fn), NULL, NULL, NULL };
+    const struct ir_block *bb;
+    struct ir_inst *inst, **root;
+    const char *scratch[NUM_SCRATCH];
+    bool *kept, used[NUM_LEAF_ALLOCATABLE] = { false }, slots = false;
+    int *assigned, *hint, *clobber, rdx = -1;
+    uintmax_t words;
+    unsigned i, deepest = 0, spills = 0;
+
+    // phi operands are copied at the end of the predecessor
+    ir_split_critical_edges(fn);
+
+    if (x.leaf) {
+        memcpy(scratch, leaf_scratch_registers, sizeof(leaf_scratch_registers));
+        x.scratch = scratch;
+        x.num_scratch = NUM_LEAF_SCRATCH;
+        x.temp = "%rax";
+        x.allocatable = leaf_allocatable_registers;
+        x.num_allocatable = NUM_LEAF_ALLOCATABLE;
+    }
+    else {
+        x.scratch = scratch_registers;
+        x.num_scratch = NUM_SCRATCH;
+        x.temp = "%rcx";
+        x.allocatable = allocatable_registers;
+        x.num_allocatable = NUM_ALLOCATABLE;
+    }
+    for (i = 0; i < x.num_allocatable; i++)
+        if (!strcmp(x.allocatable[i], "%rdx"))
+            rdx = i;
+
+    x.home = calloc(fn->num_insts, sizeof(intptr_t));
+    x.reg = calloc(fn->num_insts, sizeof(const char*));
+    x.inlined = calloc(fn->num_insts, sizeof(bool));
+    x.need = calloc(fn->num_insts, sizeof(unsigned));
+    form_trees(&x);
+
+    // values of expression trees are read where the root of the tree is;
+    // arguments would rather stay where they come in, and values live
+    // across a division not in %rdx
+    kept = calloc(fn->num_insts, sizeof(bool));
+    root = malloc(fn->num_insts * sizeof(struct ir_inst*));
+    assigned = malloc(fn->num_insts * sizeof(int));
+    hint = malloc(fn->num_insts * sizeof(int));
+    clobber = malloc(fn->num_insts * sizeof(int));
+    for (bb = fn->exit; bb; bb = bb->prev) {
+        for (inst = bb->last; inst; inst = inst->prev) {
+            root[inst->id] = x.inlined[inst->id] ? root[inst->uses->user->id] : inst;
+            kept[inst->id] = ir_has_uses(inst) && !rematerialized(inst) && !x.inlined[inst->id];
+            hint[inst->id] = -1;
+            clobber[inst->id] = -1;
+            if (overwrites_rdx(inst))
+                clobber[root[inst->id]->id] = rdx;
+            for (i = 0; inst->op == IR_PARAM && i < x.num_allocatable; i++)
+                if (!strcmp(x.allocatable[i], arg_registers[inst->imm]))
+                    hint[inst->id] = i;
+            slots |= inst->op == IR_SLOT;
+        }
+    }
+    linear_scan(fn, kept, root, hint, clobber, x.num_allocatable, assigned);
+
+    // a padding word, the stack slots, the callee-saved registers in use,
+    // then a home for every value kept on the stack
+    x.slots = calloc(fn->num_slots, sizeof(intptr_t));
+    words = 1 + place_slots(&x);
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (kept[inst->id] && assigned[inst->id] >= 0) {
+                x.reg[inst->id] = x.allocatable[assigned[inst->id]];
+                x.saved[assigned[inst->id]] = is_callee_saved(x.reg[inst->id]);
+                used[assigned[inst->id]] = true;
+                x.keeps_rcx |= !strcmp(x.reg[inst->id], "%rcx");
+            }
+            else if (kept[inst->id])
+                x.frame = true;
+        }
+    }
+    number_trees(&x);
+
+    // caller-saved registers no value is kept in evaluate the trees of leaf
+    // functions. So do unused callee-saved ones, which are saved once, when
+    // the trees would go to the stack more often: a tree needing k more
+    // registers than there are goes there at least 2^k - 1 times
+    for (i = 0; x.leaf && i < x.num_allocatable && x.num_scratch < NUM_SCRATCH; i++)
+        if (!used[i] && !is_callee_saved(x.allocatable[i]) && (int) i != rdx && strcmp(x.allocatable[i], "%rcx"))
+            scratch[x.num_scratch++] = x.allocatable[i];
+    for (bb = fn->entry; bb; bb = bb->next) {
+        for (inst = bb->first; inst; inst = inst->next) {
+            if (x.need[inst->id] > deepest)
+                deepest = x.need[inst->id];
+            if (x.need[inst->id] <= x.num_scratch)
+                continue;
+            for (i = 0; i < inst->num_args && need(&x, inst->args[i].value) <= x.num_scratch; i++)
+                ;
+            spills += i == inst->num_args;
+        }
+    }
+    for (i = 0; x.leaf && (deepest > x.num_scratch + 1 || spills > 1) && i < x.num_allocatable
+            && x.num_scratch < deepest && x.num_scratch < NUM_SCRATCH; i++) {
+        if (!used[i] && is_callee_saved(x.allocatable[i])) {
+            scratch[x.num_scratch++] = x.allocatable[i];
+            x.saved[i] = true;
+        }
+    }
+
+    // leaf functions with nothing on the stack need no frame, and push the
+    // callee-saved registers they use instead
+    x.frame = x.frame || !x.leaf || slots;
+    for (i = 0; i < x.num_allocatable; i++)
+        if (x.saved[i] && x.frame)
+            x.saved[i] = -(intptr_t) ++words * args->word_size;
+    for (bb = fn->entry; bb; bb = bb->next)
+        for (inst = bb->first; inst; inst = inst->next)
+            if (kept[inst->id] && !x.reg[inst->id])
+                x.home[inst->id] = -(intptr_t) ++words * args->word_size;
+    words += words % 2;
+    lay_out(&x);
+
+    fprintf(out,
+        ".text\n"
+        ".type %s, @function\n"
+        "%s:\n",
+        fn->name, fn->name
+    );
+    if (x.frame)
+        fprintf(out,
+            "  push %%rbp\n"
+            "  mov %%rsp, %%rbp\n"
+            "  sub $%ju, %%rsp\n",
+            words * args->word_size
+        );
+    for (i = 0; i < x.num_allocatable; i++) {
+        if (x.saved[i] && x.frame)
+            fprintf(out, "  mov %s, %ld(%%rbp)\n", x.allocatable[i], x.saved[i]);
+        else if (x.saved[i])
+            fprintf(out, "  push %s\n", x.allocatable[i]);
+    }
+
+    // loop heads are aligned for the jumps back to them
+    for (bb = fn->entry; bb; bb = bb->next) {
+        if (x.target[bb->id] != bb)
+            continue;
+        if (x.head[bb->id])
+            fprintf(out, "  .p2align 4,,10\n");
+        block_label(&x, bb);
+        fprintf(out, ":\n");
+        for (inst = bb->first; inst; inst = inst->next)
+            instruction(&x, inst);
+    }
+
+    free(x.slots);
+    free(x.home);
+    free(x.reg);
+    free(x.inlined);
+    free(x.need);
+    free(x.target);
+    free(x.next);
+    free(x.head);
+    free(kept);
+    free(root);
+    free(assigned);
+    free(hint);
+    free(clobber);
+}
@@ -0,0 +1,15 @@
+#ifndef BCAUSE_X86_H
+#define BCAUSE_X86_H
+
+#include <stdio.h>
+
+#include "codegen.h"
+#include "compiler.h"
+#include "ir.h"
+
+//
+// Generate x86_64 assembly for a function in intermediate code.
+//
+void x86_function(struct compiler_args *args, FILE *out, struct ir_function *fn, const struct codegen_ids *ids);
+
+#endif /* BCAUSE_X86_H */
@@ -0,0 +1,75 @@
+#include "fixture.h"
+
+TEST_F(bcause, error_missing_semicolon)
+{
+    auto output = compile_error(R"(main() {
+    auto x;
+    x = 1
+
+    x = 2;
+}
+)");
+    EXPECT_NE(output.find("error_missing_semicolon.b:3:"), std::string::npos);
+}
+
+TEST_F(bcause, error_after_comments_and_strings)
+{
+    auto output = compile_error(R"(main() {
+    /* a comment
+       over several lines */
+    printf("a*nb
+c");
+    y;
+}
+)");
+    EXPECT_NE(output.find("error_after_comments_and_strings.b:6:"), std::string::npos);
+}
+
+TEST_F(bcause, error_unclosed_block)
+{
+    auto output = compile_error(R"(main() {
+    if (1) {
+        return;
+
+)");
+    EXPECT_NE(output.find("error_unclosed_block.b:2:"), std::string::npos);
+}
+
+TEST_F(bcause, error_out_of_scope)
+{
+    auto output = compile_error(R"(main() {
+    if (1) {
+        auto x;
+        x = 1;
+    }
+    x = 2;
+}
+)");
+    EXPECT_NE(output.find("error_out_of_scope.b:6: "), std::string::npos);
+    EXPECT_NE(output.find("undefined identifier"), std::string::npos);
+}
+
+TEST_F(bcause, error_undefined_label)
+{
+    auto output = compile_error(R"(main() {
+    goto here;
+    goto there;
+here:
+    return;
+}
+)");
+    EXPECT_NE(output.find("error_undefined_label.b:3: "), std::string::npos);
+    EXPECT_NE(output.find("undefined label"), std::string::npos);
+}
+
+TEST_F(bcause, error_duplicate_label)
+{
+    auto output = compile_error(R"(main() {
+here:
+    ;
+here:
+    return;
+}
+)");
+    EXPECT_NE(output.find("error_duplicate_label.b:4: "), std::string::npos);
+}
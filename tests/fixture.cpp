@@ -26,7 +26,7 @@ static void run_command(std::string &result, const std::string &cmd)
 // Compile and run B code.
 // Return captured output.
 //
-std::string bcause::compile_and_run(const std::string &source_code)
+std::string bcause::compile_and_run(const std::string &source_code, const std::string &options)
 {
     const auto b_filename   = test_name + ".b";
     const auto exe_filename = test_name;
@@ -36,7 +36,7 @@ std::string bcause::compile_and_run(const std::string &source_code)
 
     // Compile B source into executable binary.
     std::string result;
-    run_command(result, "../bcause --save-temps -L.. " + b_filename + " -o " + exe_filename);
+    run_command(result, "../bcause --save-temps -L.. " + options + " " + b_filename + " -o " + exe_filename);
 
     // Run the binary.
     run_command(result, "./" + exe_filename);
@@ -45,6 +45,34 @@ std::string bcause::compile_and_run(const std::string &source_code)
     return result;
 }
 
+//
+// Compile B code that is expected to fail.
+// Return captured error messages.
+//
+std::string bcause::compile_error(const std::string &source_code, const std::string &options)
+{
+    const auto b_filename = test_name + ".b";
+    const auto cmd = "../bcause -S " + options + " " + b_filename + " -o " + test_name + ".s 2>&1";
+
+    create_file(b_filename, source_code);
+
+    std::cout << cmd << '\n';
+    FILE *pipe = popen(cmd.c_str(), "r");
+    EXPECT_TRUE(pipe != nullptr);
+    if (!pipe)
+        return "";
+
+    // Capture output.
+    auto result = stream_contents(pipe);
+    std::cout << result;
+
+    // Compilation must fail.
+    int exit_status = pclose(pipe);
+    EXPECT_NE(exit_status, -1);
+    EXPECT_NE(WEXITSTATUS(exit_status), 0);
+    return result;
+}
+
 //
 // Read file contents and return it as a string.
 //
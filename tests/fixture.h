@@ -23,7 +23,11 @@ protected:
 
     // Compile and run B code.
     // Return captured output.
-    std::string compile_and_run(const std::string &input);
+    std::string compile_and_run(const std::string &input, const std::string &options = "");
+
+    // Compile B code that is expected to fail.
+    // Return captured error messages.
+    std::string compile_error(const std::string &input, const std::string &options = "");
 };
 
 //
@@ -90,3 +90,34 @@ TEST_F(bcause, function_ternary_operator)
 )";
     EXPECT_EQ(output, expect);
 }
+
+TEST_F(bcause, if_else_braces)
+{
+    auto output = compile_and_run(R"(
+        f(x) {
+            if (x) {
+                putchar('then');
+            } else{
+                putchar('else');
+                putchar('!');
+            }
+            putchar('*n');
+        }
+
+        main() {
+            auto elsewhere;
+            elsewhere = 0;
+            f(1);
+            f(elsewhere);
+            if (elsewhere)
+                putchar('bad');
+            elsewhere = 1;
+            printf("%d*n", elsewhere);
+        }
+    )");
+    const std::string expect = R"(then
+else!
+1
+)";
+    EXPECT_EQ(output, expect);
+}
@@ -86,3 +86,25 @@ offset c = -1008
 )";
     EXPECT_EQ(output, expect);
 }
+
+TEST_F(bcause, local_block_scopes)
+{
+    auto output = compile_and_run(R"(
+        main() {
+            auto a;
+            a = 1;
+            if (a) {
+                auto b;
+                b = 2;
+                a =+ b;
+            }
+            if (a) {
+                auto c[10], b;
+                b = 40;
+                a =+ b;
+            }
+            printf("a = %d*n", a);
+        }
+    )");
+    EXPECT_EQ(output, "a = 43\n");
+}
@@ -0,0 +1,988 @@
+#include "fixture.h"
+
+//
+// The code of function `name` in the assembly of a file.
+//
+static std::string function_code(const std::string &assembly, const std::string &name)
+{
+    const auto start = assembly.find("\n" + name + ":\n");
+    if (start == std::string::npos)
+        return "";
+    const auto end = assembly.find("\n.type ", start);
+    return assembly.substr(start, end == std::string::npos ? end : end - start);
+}
+
+//
+// Control flow of every kind, to be compiled at each optimization level.
+//
+static const std::string control_flow = R"(
+    fact(n) return (n <= 1 ? 1 : n * fact(n - 1));
+
+    classify(c) {
+        switch (c) {
+        case 'a': case 'e': case 'i': case 'o': case 'u':
+            return ('v');
+        case ' ':
+            return ('s');
+        }
+        return ('c');
+    }
+
+    main() {
+        auto i, v[5], n;
+
+        i = 0;
+        while (i < 5) {
+            v[i] = fact(i + 1);
+            i++;
+        }
+        n = 0;
+    loop:
+        printf("%d ", v[n]);
+        if (++n < 5)
+            goto loop;
+        printf("*n%c%c%c*n", classify('a'), classify(' '), classify('x'));
+    }
+)";
+
+TEST_F(bcause, optimize_levels)
+{
+    const std::string expect = "1 2 6 24 120 \nvsc\n";
+
+    EXPECT_EQ(compile_and_run(control_flow, "-O0"), expect);
+    EXPECT_EQ(compile_and_run(control_flow, "-O1"), expect);
+    EXPECT_EQ(compile_and_run(control_flow, "-O2"), expect);
+}
+
+TEST_F(bcause, optimize_evaluation_order)
+{
+    auto output = compile_and_run(R"(
+        x;
+        bump() {
+            extrn x;
+            return (++x);
+        }
+
+        main() {
+            extrn x;
+            auto v[3], i;
+
+            x = 1;
+            x =+ bump();
+            i = 0;
+            v[i++] = i;
+            printf("%d %d %d*n", x, v[0], i);
+        }
+    )", "-O2");
+    EXPECT_EQ(output, "3 1 1\n");
+}
+
+//
+// Build a balanced expression tree of the given depth over the variables a to h.
+//
+static std::string balanced_expr(int depth, int &leaf)
+{
+    static const char *ops[] = { "+", "-", "*", "+" };
+
+    if (!depth)
+        return std::string(1, 'a' + leaf++ % 8);
+    auto lhs = balanced_expr(depth - 1, leaf);
+    return "(" + lhs + ops[depth % 4] + balanced_expr(depth - 1, leaf) + ")";
+}
+
+TEST_F(bcause, optimize_register_pressure)
+{
+    int leaf = 0, tree_leaf = 0;
+    const std::string code = R"(
+        digits(a, b, c, d, e, g) return (((((a * 10 + b) * 10 + c) * 10 + d) * 10 + e) * 10 + g);
+
+        tree(v) {
+            auto a, b, c, d, e, f, g, h;
+
+            a = v[0]; b = v[1]; c = v[2]; d = v[3]; e = v[4]; f = v[5]; g = v[6]; h = v[7];
+            return )" + balanced_expr(5, tree_leaf) + R"(;
+        }
+
+        main() {
+            auto a, b, c, d, e, f, g, h, v[8];
+
+            a = 1; b = 2; c = 3; d = 4; e = 5; f = 6; g = 7; h = 8;
+            v[0] = 9; v[1] = 2; v[2] = 7; v[3] = 4; v[4] = 5; v[5] = 1; v[6] = 3; v[7] = 8;
+            printf("%d %d*n", )" + balanced_expr(8, leaf) + R"( % 1000003, tree(v));
+            printf("%d*n", digits(b - a, a + 1, c / b + 2, d * 1, e % 6, f - 0));
+            printf("%d*n", digits(a + b, a + c, a + d, a + e, a + f, a + g));
+        }
+    )";
+
+    auto output = compile_and_run(code, "-O0");
+    EXPECT_EQ(compile_and_run(code, "-O2"), output);
+    EXPECT_EQ(output.substr(output.find('\n') + 1), "123456\n345678\n");
+
+    // the eight values of tree take eight registers, and the temporaries of
+    // its expression the callee-saved ones left: the only pushes and pops
+    // save those on entry and restore them on return
+    const auto tree = function_code(file_contents(test_name + ".s"), "tree");
+    const auto body = tree.find(".L.bb0.tree:\n");
+    ASSERT_NE(body, std::string::npos);
+    EXPECT_EQ(tree.find("push", body), std::string::npos);
+    for (auto pos = tree.find("  pop "); pos != std::string::npos; pos = tree.find("  pop ", pos + 1)) {
+        const auto next = tree.substr(tree.find('\n', pos) + 1, 6);
+        EXPECT_TRUE(next == "  pop " || next == "  ret\n") << tree.substr(pos, 16);
+    }
+}
+
+TEST_F(bcause, optimize_register_allocation)
+{
+    const std::string code = R"(
+        id(x) return (x);
+
+        escape() {
+            auto a, p;
+
+            p = &a;
+            a = 5;
+            *p = *p + 1;
+            return (a);
+        }
+
+        hot(n) {
+            auto a, b, c, d, e, i, s, t;
+
+            a = id(n);
+            b = id(n + 1);
+            c = id(n + 2);
+            d = id(n + 3);
+            e = id(n + 4);
+            i = s = t = 0;
+            while (i < n) {
+                s =+ i * i;
+                t =+ s & i;
+                i++;
+            }
+            a = id(a * b - c * d + e);
+            return (a + s - t + i + n);
+        }
+
+        main() {
+            auto a, b, c, d, e, f, g, h, i, v[3];
+
+            a = b = c = d = 1;
+            e = f = g = h = 2;
+            i = 0;
+            while (i < 10) {
+                a = id(a + b);
+                b = c + id(d);
+                c = d * e;
+                d = e - f + g;
+                e = f + 1;
+                f = g + h;
+                g = h - 1;
+                h = i++;
+                v[i % 3] = a + b + c + d + e + f + g + h;
+            }
+            printf("%d %d %d %d ", a, b, c, d);
+            printf("%d %d %d %d %d*n", e, f, g, h, v[0] + v[1] + v[2]);
+            printf("%d %d*n", escape(), hot(1000));
+        }
+    )";
+
+    auto output = compile_and_run(code, "-O0");
+    EXPECT_EQ(compile_and_run(code, "-O1"), output);
+    EXPECT_EQ(compile_and_run(code, "-O2"), output);
+    EXPECT_EQ(compile_and_run(code, "-O2 --inline-limit=0"), output);
+    EXPECT_EQ(output.substr(output.find('\n') + 1), "6 332581288\n");
+
+    // the values of the loop in hot stay in callee-saved registers, and n
+    // is kept there rather than a..e, which live longer but are not used
+    // in the loop: nothing is read from the frame between the loop head and
+    // the jump back to it
+    const auto hot = function_code(file_contents(test_name + ".s"), "hot");
+    const std::string align = "  .p2align 4,,10\n";
+    const auto head = hot.find(align);
+    ASSERT_NE(head, std::string::npos);
+    const auto label = hot.substr(head + align.size(), hot.find(":\n", head) - head - align.size());
+    const auto back = hot.find(" " + label + "\n", head + align.size() + label.size());
+    ASSERT_NE(back, std::string::npos);
+    const auto loop = hot.substr(head, back - head);
+    EXPECT_EQ(loop.find("(%rbp)"), std::string::npos) << loop;
+    EXPECT_NE(loop.find("%rbx"), std::string::npos) << loop;
+    EXPECT_NE(loop.find("%r12"), std::string::npos) << loop;
+}
+
+TEST_F(bcause, optimize_read_modify_write)
+{
+    const std::string code = R"(
+        x; y;
+
+        f(p) {
+            extrn x, y;
+            auto a;
+
+            a = 0;
+            x =+ y;
+            x =+ 5;
+            y = -y;
+            x =<< 2;
+            x = 1 | x;
+            *p =+ 3;
+            p[1] = 1 - p[1];
+            a = a + x;
+            a =* y;
+            return (a + x);
+        }
+
+        s(n) {
+            auto w[3], i;
+
+            w[0] = w[1] = w[2] = n;
+            i = 0;
+            while (i < n) {
+                w[1] =+ 4;
+                w[2] = 2 | w[2];
+                i++;
+            }
+            return (w[0] + w[1] + w[2]);
+        }
+
+        main() {
+            extrn x, y;
+            auto v[2];
+
+            x = 1;
+            y = 2;
+            v[0] = 0;
+            v[1] = 10;
+            printf("%d %d %d %d %d ", f(v), x, y, v[0], v[1]);
+            printf("%d*n", s(5));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "-33 33 -2 3 -9 37\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "-33 33 -2 3 -9 37\n");
+
+    // the global and the stack slots are added to, or-ed with and shifted in
+    // memory, not loaded into a register and stored back
+    const auto assembly = file_contents(test_name + ".s");
+    const auto f = function_code(assembly, "f");
+    for (const auto *rmw : { "  addq $5, x(%rip)\n", "  shlq $2, x(%rip)\n", "  orq $1, x(%rip)\n", "  addq $3, (%rdi)\n" })
+        EXPECT_NE(f.find(rmw), std::string::npos) << rmw;
+    EXPECT_EQ(f.find("mov x(%rip)"), std::string::npos);
+    const auto s = function_code(assembly, "s");
+    EXPECT_NE(s.find("  addq $4, -"), std::string::npos);
+    EXPECT_NE(s.find("  orq $2, -"), std::string::npos);
+    EXPECT_EQ(s.find("  lea "), std::string::npos);
+    const auto loop = s.substr(s.find("  .p2align"));
+    EXPECT_EQ(loop.substr(0, loop.find("  jl ")).find("mov"), std::string::npos);
+}
+
+TEST_F(bcause, optimize_vector_subscripts)
+{
+    const std::string code = R"(
+        v[10] 1, 2, 3;
+
+        sum(p, n) {
+            auto i, s;
+
+            s = 0;
+            i = 0;
+            while (i < n)
+                s =+ p[i++];
+            return (s);
+        }
+
+        main() {
+            extrn v;
+            auto a[8], i;
+
+            i = 0;
+            while (i < 8) {
+                a[i] = i * i;
+                i++;
+            }
+            a[3] =+ 100;
+            a[i - 1] =* 2;
+            v[4] = a[2] + v[1];
+            v[i] = 7;
+            printf("%d %d %d %d*n", sum(a, 8), a[3], a[7], v[4]);
+            printf("%d %d*n", sum(v, 10), v[8]);
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "289 109 98 6\n19 7\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "289 109 98 6\n19 7\n");
+
+    // subscripts are scaled by the addressing mode, with a constant added to
+    // them in the displacement, and `a[i - 1] =* 2` shifts the element in
+    // place; no index is shifted or multiplied by eight on its own
+    const auto assembly = file_contents(test_name + ".s");
+    const auto sum = function_code(assembly, "sum");
+    const auto main = function_code(assembly, "main");
+    EXPECT_NE(sum.find("  add (%rdi,"), std::string::npos);
+    EXPECT_NE(main.find("  shlq $1, -80(%rbp,"), std::string::npos);
+    for (const auto &body : { sum, main }) {
+        EXPECT_NE(body.find(",8)"), std::string::npos);
+        EXPECT_EQ(body.find("shl $3,"), std::string::npos);
+        EXPECT_EQ(body.find("imul $8,"), std::string::npos);
+    }
+}
+
+TEST_F(bcause, optimize_constant_propagation)
+{
+    const std::string code = R"(
+        f(x) {
+            auto a, b, k;
+
+            a = 6;
+            b = a * 7 - 2;
+            k = 3;
+            switch (k) {
+            case 1:
+                a = 100;
+            case 3:
+                a =+ 1;
+                goto out;
+            default:
+                a = 0;
+            }
+        out:
+            if (x)
+                b = 40;
+            while (b != 40)
+                b = 0;
+            return (a * 1000 + b + ('0' + 1 - '0') + (-5 >> 1) + (1 << 4) % 7);
+        }
+
+        g(x) {
+            auto k, n;
+
+            k = 3;
+            n = k * 4 - 10;
+            if (k > n)
+                x =+ n;
+            else
+                x = x * 5;
+            while (k < n)
+                x = 0;
+            return (x);
+        }
+
+        main() {
+            printf("%d %d %d*n", f(0), f(1), g(5));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "7040 7040 7\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "7040 7040 7\n");
+
+    // f returns a constant whatever x is, and the branches of g, whose
+    // outcomes are known, are gone with their other side
+    const auto assembly = file_contents(test_name + ".s");
+    const auto f = function_code(assembly, "f");
+    const auto g = function_code(assembly, "g");
+    EXPECT_NE(f.find(":\n  mov $7040, %rax\n  ret\n"), std::string::npos) << f;
+    for (const auto &body : { f, g }) {
+        EXPECT_EQ(body.find("  cmp "), std::string::npos) << body;
+        EXPECT_EQ(body.find("  j"), std::string::npos) << body;
+        EXPECT_EQ(body.find("  imul "), std::string::npos) << body;
+    }
+}
+
+TEST_F(bcause, optimize_branch_conditions)
+{
+    const std::string code = R"(
+        g 5;
+
+        f(a, b, p) {
+            extrn g;
+            auto n, t;
+
+            n = 0;
+            if (a < b) n =+ 1;
+            if (!(a < b)) n =+ 2;
+            if (!!(a >= b)) n =+ 4;
+            if (!a) n =+ 8;
+            if (a == g) n =+ 16;
+            if (*p != b) n =+ 32;
+            if (g > a + b) n =+ 64;
+            t = a <= b;
+            n =+ (a > b ? 128 : 256);
+            while (!(*p >= 3))
+                *p =+ 1;
+            return (n * 10 + t);
+        }
+
+        h(n) {
+            auto s;
+
+            s = 0;
+            while (1) {
+                s =+ n;
+                if (--n <= 0)
+                    return (s);
+            }
+        }
+
+        main() {
+            auto v;
+
+            v = 0;
+            printf("%d ", f(0, 1, &v));
+            printf("%d ", f(5, 5, &v));
+            printf("%d %d %d*n", f(7, -2, &v), v, h(10));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "3611 3101 1660 3 55\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "3611 3101 1660 3 55\n");
+
+    // every conditional jump follows the compare or test setting its flags,
+    // with no boolean made of them in between, zero is tested for rather
+    // than compared with, and `while (1)` tests nothing
+    const auto assembly = file_contents(test_name + ".s");
+    size_t tests = 0;
+    for (const auto *name : { "f", "h" }) {
+        const auto body = function_code(assembly, name);
+        ASSERT_FALSE(body.empty()) << name;
+        EXPECT_EQ(body.find("cmp $0,"), std::string::npos) << name;
+        for (auto pos = body.find("\n  j"); pos != std::string::npos; pos = body.find("\n  j", pos + 1)) {
+            if (body.compare(pos, 6, "\n  jmp") == 0)
+                continue;
+            const auto prev = body.substr(body.rfind('\n', pos - 1) + 1, 6);
+            EXPECT_TRUE(prev == "  cmp " || prev == "  test")
+                << name << ": " << body.substr(pos + 1, body.find('\n', pos + 1) - pos - 1) << " after " << prev;
+        }
+        for (auto pos = body.find("  test "); *name == 'h' && pos != std::string::npos; pos = body.find("  test ", pos + 1))
+            tests++;
+        for (auto pos = body.find("  cmp "); *name == 'h' && pos != std::string::npos; pos = body.find("  cmp ", pos + 1))
+            tests++;
+    }
+    EXPECT_EQ(tests, 1u);
+}
+
+TEST_F(bcause, optimize_switch_dispatch)
+{
+    const std::string code = R"(
+        dense(c) {
+            switch (c) {
+            case 'a': return (1);
+            case 'b': return (2);
+            case 'd': return (3);
+            case 'e': return (4);
+            case 'g':
+            case 'h': return (5);
+            case 'k': return (6);
+            }
+            return (0);
+        }
+
+        sparse(c) {
+            switch (c) {
+            case 0: return (1);
+            case 7: return (2);
+            case 99: return (3);
+            case 1000: return (4);
+            case 4096: return (5);
+            case 65536: return (6);
+            case 1000000: return (7);
+            case 2000000000: return (8);
+            }
+            return (0);
+        }
+
+        main() {
+            extrn values;
+            auto i, s;
+
+            s = 0;
+            i = 90;
+            while (i < 110)
+                s = s * 7 + dense(i++);
+            printf("%d ", s);
+            s = 0;
+            i = 0;
+            while (i < 10)
+                s = s * 9 + sparse(values[i++]);
+            printf("%d*n", s);
+        }
+
+        values[10] 2000000000, 1000000, 65536, 4096, 1000, 99, 7, 0, 1, 65535;
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "17940733286 3432303396\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "17940733286 3432303396\n");
+
+    // the close cases are looked up in a table, the far ones searched in halves
+    const auto assembly = file_contents(test_name + ".s");
+    const auto dense = function_code(assembly, "dense");
+    const auto sparse = function_code(assembly, "sparse");
+    EXPECT_NE(dense.find(".L.table"), std::string::npos);
+    EXPECT_EQ(sparse.find(".L.table"), std::string::npos);
+    EXPECT_NE(sparse.find(".L.case"), std::string::npos);
+}
+
+TEST_F(bcause, optimize_constant_division)
+{
+    const std::string code = R"(
+        digits(n) {
+            auto s;
+
+            s = 0;
+            while (n) {
+                s = s * 10 + n % 10;
+                n = n / 10;
+            }
+            return (s);
+        }
+
+        check(x) {
+            auto h;
+
+            h = x / 7 + x % 7 * 3;
+            h = h * 31 + x / 8 - x % 8;
+            h = h * 31 + x / -16 + x % -16;
+            h = h * 31 + x / 1000000007 + x % 641;
+            h = h * 31 + x * 3 + x * 40 - x * -8;
+            return (h * 31 + x * 1000);
+        }
+
+        main() {
+            auto i, h;
+
+            h = digits(9876543210);
+            i = -50;
+            while (i < 50) {
+                h = h * 7 + check(i * 987654321);
+                i++;
+            }
+            printf("%d %d*n", digits(-1234), h);
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "-4321 -8185652058548273119\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "-4321 -8185652058548273119\n");
+
+    // every divisor is a constant, so nothing is left for idiv
+    const auto assembly = file_contents(test_name + ".s");
+    const auto digits = function_code(assembly, "digits");
+    const auto check = function_code(assembly, "check");
+    ASSERT_FALSE(digits.empty());
+    ASSERT_FALSE(check.empty());
+    EXPECT_EQ(digits.find("idivq"), std::string::npos);
+    EXPECT_EQ(check.find("idivq"), std::string::npos);
+}
+
+TEST_F(bcause, optimize_inlining)
+{
+    const std::string code = R"(
+        get(v, i) return (v[i]);
+        put(v, i, x) v[i] = x;
+        sq(x) return (x * x);
+        max(a, b) return (a > b ? a : b);
+        msg() return ("hi");
+        fact(n) return (n <= 1 ? 1 : n * fact(n - 1));
+        early(x) {
+            if (x < 0)
+                return (-x);
+        lbl:
+            if (x > 100) {
+                x =- 100;
+                goto lbl;
+            }
+            return (x);
+        }
+
+        main() {
+            auto v[4], i, s;
+
+            i = 0;
+            while (i < 4) {
+                put(v, i, sq(i + 1));
+                i++;
+            }
+            s = 0;
+            i = 0;
+            while (i < 4)
+                s = max(s, get(v, i++)) + 1;
+            printf("%d %d %s ", s, fact(5), msg());
+            printf("%d %d %d*n", early(-7), early(350), early(5));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "17 120 hi 7 50 5\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "17 120 hi 7 50 5\n");
+    EXPECT_EQ(compile_and_run(code, "-O2 --inline-limit=0"), "17 120 hi 7 50 5\n");
+}
+
+TEST_F(bcause, optimize_direct_calls)
+{
+    const std::string code = R"(
+        main() {
+            extrn count;
+
+            walk(5);
+            putchar('*n');
+            printf("%d %d*n", count, ack(2, 3));
+        }
+
+        count;
+
+        walk(n) {
+            extrn count;
+
+            count =+ n;
+            if (n > 0) {
+                putchar('0' + n);
+                walk(n - 1);
+            }
+        }
+
+        ack(m, n) {
+            if (m == 0)
+                return (n + 1);
+            if (n == 0)
+                return (ack(m - 1, 1));
+            return (ack(m - 1, ack(m, n - 1)));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "54321\n15 9\n");
+    EXPECT_EQ(compile_and_run(code, "-O1"), "54321\n15 9\n");
+    EXPECT_EQ(compile_and_run(code, "-O2 --inline-limit=0"), "54321\n15 9\n");
+
+    // every callee is named, so no call goes through a register
+    const auto assembly = file_contents(test_name + ".s");
+    EXPECT_NE(assembly.find("  call walk\n"), std::string::npos);
+    EXPECT_NE(assembly.find("  call ack\n"), std::string::npos);
+    EXPECT_EQ(assembly.find("  call *%r10\n"), std::string::npos);
+}
+
+TEST_F(bcause, optimize_tail_calls)
+{
+    // too deep for a frame per call
+    const std::string code = R"(
+        sum(n, acc) {
+            if (n == 0)
+                return (acc);
+            return (sum(n - 1, acc + n));
+        }
+
+        even(n) return (n == 0 ? 1 : odd(n - 1));
+        odd(n) return (n == 0 ? 0 : even(n - 1));
+
+        chain(p, n) {
+            auto x;
+
+            x = n;
+            if (n == 0)
+                return (*p);
+            return (chain(&x, n - 1));
+        }
+
+        count(n, k) {
+            if (n == 0)
+                return (k);
+            return (count(n - 1));
+        }
+
+        main() {
+            extrn depth;
+
+            printf("%d %d ", sum(depth, 0), even(depth + 1));
+            printf("%d %d*n", chain(&depth, 5), count(7, 3));
+        }
+
+        depth 3000000;
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O1"), "4500001500000 0 1 3\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "4500001500000 0 1 3\n");
+}
+
+TEST_F(bcause, optimize_leaf_functions)
+{
+    const std::string code = R"(
+        mix(a, b, c, d, e, f) return (((a - b) * (c + d) - (e - f) * (a + f)) / ((b | 1) + (c & 7) * (d << 3)));
+
+        swap(a, b, c, d, e, f) return (f * 100000 + e * 10000 + d * 1000 + c * 100 + b * 10 + a);
+
+        many(a, b, c, d, e, f) return (a + b + c + d + e + f);
+
+        addr(a, b) {
+            auto p;
+
+            p = &a;
+            *p =+ b;
+            return (a);
+        }
+
+        busy(n) {
+            auto a, b, c, d, e, f, g, h, i, j, k;
+
+            a = b = c = d = e = f = g = h = i = j = 0;
+            k = 0;
+            while (k < n) {
+                a =+ k; b =+ a; c =+ b >> 2; d =+ c & 255; e =+ d | 1;
+                f =+ e % 7; g =+ f * 3; h =+ g - a; i =+ h / 3; j =+ i + e;
+                k++;
+            }
+            return (a + b + c + d + e + f + g + h + i + j);
+        }
+
+        pick(x) {
+            switch (x) {
+            case 0: return (5);
+            case 1: return (7);
+            case 2: return (11);
+            case 3: return (13);
+            case 4: return (17);
+            }
+            return (x);
+        }
+
+        main() {
+            auto i, s;
+
+            s = 0;
+            i = 0;
+            while (i < 9) {
+                s = s * 3 + pick(i) + mix(i, 2, 3, i + 4, 5, 6);
+                i++;
+            }
+            printf("%d %d %d %d %d*n", s, swap(1, 2, 3, 4, 5, 6), many(1, 2, 3, 4, 5, 6), addr(30, 12), busy(50));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "60887 654321 21 42 8623834\n");
+    EXPECT_EQ(compile_and_run(code, "-O1"), "60887 654321 21 42 8623834\n");
+    EXPECT_EQ(compile_and_run(code, "-O2 --inline-limit=0"), "60887 654321 21 42 8623834\n");
+
+    // no frame, no callee-saved register, and all six arguments stay in the
+    // registers they come in: they are only read into scratch registers.
+    // Only mix needs a third scratch register, for which an operand waits on
+    // the stack.
+    const auto assembly = file_contents(test_name + ".s");
+    for (const auto *name : { "mix", "swap", "many" }) {
+        const auto body = function_code(assembly, name);
+        ASSERT_FALSE(body.empty()) << name;
+        EXPECT_EQ(body.find("push %rbp"), std::string::npos) << name;
+        for (const auto *reg : { "%rbx", "%r12", "%r13", "%r14", "%r15" })
+            EXPECT_EQ(body.find(reg), std::string::npos) << name << ": " << reg;
+        if (std::string(name) != "mix") {
+            EXPECT_EQ(body.find("push"), std::string::npos) << name;
+        }
+        for (const auto *arg : { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" }) {
+            const std::string move = std::string("  mov ") + arg + ", ";
+            for (auto pos = body.find(move); pos != std::string::npos; pos = body.find(move, pos + 1)) {
+                const auto dst = body.substr(pos + move.size(), body.find('\n', pos) - pos - move.size());
+                EXPECT_TRUE(dst == "%r10" || dst == "%r11" || dst == "%rax")
+                    << name << ": " << arg << " moved to " << dst;
+            }
+        }
+    }
+}
+
+TEST_F(bcause, optimize_frame_sharing)
+{
+    const std::string code = R"(
+        sum(v, n) {
+            auto s;
+
+            s = 0;
+            while (n > 0)
+                s =+ v[--n];
+            return (s);
+        }
+
+        fill(n) {
+            auto v[8], i;
+
+            i = 0;
+            while (i < 8) {
+                v[i] = n * i;
+                i++;
+            }
+            return (sum(v, 8));
+        }
+
+        main() {
+            auto i, t;
+
+            t = i = 0;
+            while (i < 3) {
+                t =+ fill(i) - fill(i + 1) * fill(i + 2);
+                i++;
+            }
+            {
+                auto big[100], k;
+
+                k = 0;
+                while (k < 100) {
+                    big[k] = k;
+                    k++;
+                }
+                t =+ sum(big, 100);
+            }
+        again:
+            {
+                auto w[4];
+
+                w[i & 3] = i;
+                t =+ w[i & 3];
+                if (++i < 10000)
+                    goto again;
+            }
+            printf("%d*n", t);
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "49984351\n");
+    EXPECT_EQ(compile_and_run(code, "-O1"), "49984351\n");
+    EXPECT_EQ(compile_and_run(code, "-O2 --inline-limit=100"), "49984351\n");
+}
+
+TEST_F(bcause, optimize_frame_vector_scopes)
+{
+    const std::string code = R"(
+        main() {
+            auto p, q;
+
+            q = 7;
+            p = &q;
+            {
+                auto v[3];
+
+                v[0] = 1;
+                v[1] = 2;
+                v[2] = 3;
+            }
+            {
+                auto a, b;
+
+                b = 1;
+            }
+            printf("%d*n", *p);
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "7\n");
+    EXPECT_EQ(compile_and_run(code, "-O1"), "7\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "7\n");
+}
+
+TEST_F(bcause, optimize_frame_inlined_vector)
+{
+    const std::string code = R"(
+        f1(a0, a1) {
+            auto x, y, h, p, v[4];
+
+            x = 6;
+            y = 18;
+            h = 0;
+            v[0] = 1;
+            v[1] = 2;
+            v[2] = 3;
+            v[3] = 4;
+            p = &a1;
+            return (h + x * 3 + y);
+        }
+
+        f2(a0, a1, a2, a3) {
+            auto x, y, h, p;
+
+            x = 11;
+            y = 17;
+            h = 0;
+            if (1) {
+                h =+ f1(a1, 1);
+            }
+        }
+
+        main() {
+            f2(0, 0, 0, 0);
+            printf("%d*n", f1(0, 0));
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O1"), "36\n");
+    EXPECT_EQ(compile_and_run(code, "-O2 --inline-limit=200"), "36\n");
+}
+
+TEST_F(bcause, optimize_loop_rotation)
+{
+    const std::string code = R"(
+        fib(n) {
+            auto a, b, t;
+
+            a = 0;
+            b = 1;
+            while (n-- > 0) {
+                t = a + b;
+                a = b;
+                b = t;
+            }
+            return (a);
+        }
+
+        next(p) {
+            return (*p =+ 3);
+        }
+
+        main() {
+            auto i, j, s, c, x;
+
+            s = 0;
+            i = 0;
+            while (i < 0)
+                s = 1000;
+            while ((c = next(&i)) < 30) {
+                j = c;
+                while (j-- > 0)
+                    s =+ j & c;
+            }
+            x = 2;
+            while ((x = x * 3 % 11) != 2)
+                s =+ x;
+            printf("%d %d %d %d %d*n", fib(50), s, c, i, x);
+        }
+    )";
+
+    EXPECT_EQ(compile_and_run(code, "-O0"), "12586269025 880 30 30 2\n");
+    EXPECT_EQ(compile_and_run(code, "-O1"), "12586269025 880 30 30 2\n");
+    EXPECT_EQ(compile_and_run(code, "-O2"), "12586269025 880 30 30 2\n");
+
+    // the loop head is aligned, and the loop ends in the only jump back to it,
+    // a conditional one
+    const std::string align = "  .p2align 4,,10\n";
+    const auto fib = function_code(file_contents(test_name + ".s"), "fib");
+    const auto pos = fib.find(align);
+    ASSERT_NE(pos, std::string::npos);
+    const auto head = fib.substr(pos + align.size(), fib.find(":\n", pos) - pos - align.size());
+    size_t jumps = 0;
+    for (auto at = fib.find(" " + head + "\n"); at != std::string::npos; at = fib.find(" " + head + "\n", at + 1))
+        jumps++;
+    EXPECT_EQ(jumps, 1u);
+    EXPECT_EQ(fib.find("  jmp " + head + "\n"), std::string::npos);
+}
+
+TEST_F(bcause, optimize_loop_rotation_e_2)
+{
+    const auto code = file_contents(TEST_DIR "/../examples/e-2.b");
+    const auto expect = compile_and_run(code, "-O0");
+    EXPECT_EQ(compile_and_run(code, "-O2"), expect);
+
+    // the init loop, the col loop with its two latches and the inner loop
+    // each end in the only jump back to their head, a conditional one
+    const std::string align = "  .p2align 4,,10\n";
+    const auto main = function_code(file_contents(test_name + ".s"), "main");
+    size_t loops = 0;
+    for (auto pos = main.find(align); pos != std::string::npos; pos = main.find(align, pos + 1)) {
+        const auto head = main.substr(pos + align.size(), main.find(":\n", pos) - pos - align.size());
+        size_t jumps = 0;
+        for (auto at = main.find(" " + head + "\n"); at != std::string::npos; at = main.find(" " + head + "\n", at + 1))
+            jumps++;
+        EXPECT_EQ(jumps, 1u) << head;
+        EXPECT_EQ(main.find("  jmp " + head + "\n"), std::string::npos) << head;
+        loops++;
+    }
+    EXPECT_EQ(loops, 3u);
+}
@@ -0,0 +1,79 @@
+#include <sstream>
+
+#include "fixture.h"
+
+//
+// A file big enough to be split and compiled on several threads.
+//
+static std::string large_source(int num_functions, long &expect)
+{
+    std::ostringstream src;
+
+    src << "first() return (\"first\");\n";
+    expect = 0;
+    for (int i = 0; i < num_functions; i++) {
+        src << "f" << i << "(x) {\n"
+            << "    auto s;\n"
+            << "    s = \"{f" << i << "}\"; /* } */\n"
+            << "    if (x > " << i << ") return (x - " << i << ");\n"
+            << "    return (x < 0 ? -x : x + " << i << ");\n"
+            << "}\n";
+        expect += 3 > i ? 3 - i : 3 + i;
+    }
+    src << "last() return (\"last\");\n"
+        << "main() {\n"
+        << "    auto t;\n"
+        << "    t = 0;\n";
+    for (int i = 0; i < num_functions; i++)
+        src << "    t =+ f" << i << "(3);\n";
+    src << "    printf(\"%s %d %s*n\", first(), t, last());\n"
+        << "}\n";
+    return src.str();
+}
+
+TEST_F(bcause, parallel_compile)
+{
+    long sum;
+    const auto source = large_source(1500, sum);
+    const auto expect = "first " + std::to_string(sum) + " last\n";
+
+    auto output = compile_and_run(source, "-j1");
+    EXPECT_EQ(output, expect);
+    const auto serial_asm = file_contents(test_name + ".s");
+
+    output = compile_and_run(source, "-j4");
+    EXPECT_EQ(output, expect);
+    EXPECT_EQ(file_contents(test_name + ".s"), serial_asm);
+}
+
+TEST_F(bcause, parallel_compile_inlining)
+{
+    long sum;
+    const auto source = large_source(1500, sum);
+    const auto expect = "first " + std::to_string(sum) + " last\n";
+
+    // the functions of all parts of the file are inlined, strings included
+    auto output = compile_and_run(source, "-O2 -j1");
+    EXPECT_EQ(output, expect);
+    const auto serial_asm = file_contents(test_name + ".s");
+
+    output = compile_and_run(source, "-O2 -j4");
+    EXPECT_EQ(output, expect);
+    EXPECT_EQ(file_contents(test_name + ".s"), serial_asm);
+}
+
+TEST_F(bcause, parallel_compile_errors)
+{
+    long sum;
+    auto source = large_source(1500, sum);
+
+    // break the 101st and the 1201st function
+    source.insert(source.find("f100(x) {\n") + 11, "    oops_early;\n");
+    source.insert(source.find("f1200(x) {\n") + 12, "    oops_late;\n");
+
+    // only the first error is reported, on the right line
+    auto output = compile_error(source, "-j4");
+    EXPECT_NE(output.find("parallel_compile_errors.b:603: "), std::string::npos);
+    EXPECT_NE(output.find("oops_early"), std::string::npos);
+    EXPECT_EQ(output.find("oops_late"), std::string::npos);
+}
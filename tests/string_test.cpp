@@ -51,3 +51,49 @@ TEST_F(bcause, char_literals)
 )";
     EXPECT_EQ(output, expect);
 }
+
+TEST_F(bcause, long_strings_and_comments)
+{
+    auto output = compile_and_run(R"(
+        /* a comment long enough to span several sixteen and thirty-two byte
+           blocks, with a * star and a / slash that do not close it **/
+        main() {
+            printf("abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ*n");
+            printf("0123456789abcdef*t0123456789abcdefghijklmnopqrstu*"vwxyz*n");
+            printf("%d*n", char("..............................x", 30));   /* 30 */
+        }
+    )");
+    const std::string expect = R"(abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ
+0123456789abcdef	0123456789abcdefghijklmnopqrstu"vwxyz
+120
+)";
+    EXPECT_EQ(output, expect);
+}
+
+TEST_F(bcause, shared_strings)
+{
+    auto output = compile_and_run(R"(
+        greeting "hello, world*n";
+        main() {
+            extrn greeting;
+            printf(greeting);
+            printf("world*n");
+            printf("hello, world*n");
+            printf("*n");
+            printf("");
+        }
+    )");
+    const std::string expect = R"(hello, world
+world
+hello, world
+
+)";
+    EXPECT_EQ(output, expect);
+
+    // one copy of "hello, world*n", the others point into it
+    const auto assembly = file_contents(test_name + ".s");
+    size_t labels = 0;
+    for (auto pos = assembly.find("\n.string."); pos != std::string::npos; pos = assembly.find("\n.string.", pos + 1))
+        labels++;
+    EXPECT_EQ(labels, 1u);
+}